@@ -0,0 +1,176 @@
+#include "belief_cache.h"
+
+#include <string.h>
+
+using namespace std;
+
+size_t CachedBelief::Bytes() const {
+  return joint.capacity() * sizeof(double) + \
+      active.capacity() * sizeof(pair<int, double>);
+}
+
+BeliefCache::BeliefCache(size_t budget)
+  : m_budget(budget), m_bytes(0), m_lookups(0), m_hits(0),
+    m_evictions(0) {
+}
+
+BeliefCache::~BeliefCache() {
+  Clear();
+}
+
+int BeliefCache::Find(double error, const int *obs, int length, \
+    const CachedBelief **belief) {
+  int depth(0);
+  Node *best(NULL);
+  map<double, Node *>::iterator it = m_roots.find(error);
+
+  ++m_lookups;
+
+  if (it == m_roots.end()) {
+    return 0;
+  }
+
+  // Walks the trie remembering the deepest cached node
+  Node *node = it->second;
+
+  for (int x = 0; x < length && node->children[obs[x]] != NULL; ++x) {
+    node = node->children[obs[x]];
+
+    if (node->cached) {
+      best = node;
+      depth = x+1;
+    }
+  }
+
+  if (best == NULL) {
+    return 0;
+  }
+
+  ++m_hits;
+
+  m_lru.splice(m_lru.begin(), m_lru, best->lru);
+
+  *belief = &best->belief;
+
+  return depth;
+}
+
+void BeliefCache::Insert(double error, const int *obs, int length, \
+    CachedBelief *belief) {
+  // Beliefs larger than the whole budget are never kept
+  if (belief->Bytes() + (length+1) * sizeof(Node) > m_budget) {
+    return;
+  }
+
+  Node *&root = m_roots[error];
+
+  if (root == NULL) {
+    root = AddChild(NULL, 0);
+  }
+
+  Node *node = root;
+
+  for (int x = 0; x < length; ++x) {
+    if (node->children[obs[x]] == NULL) {
+      AddChild(node, obs[x]);
+    }
+
+    node = node->children[obs[x]];
+  }
+
+  if (node->cached) {
+    m_bytes -= node->belief.Bytes();
+    m_lru.erase(node->lru);
+  }
+
+  swap(node->belief, *belief);
+
+  node->cached = true;
+  m_bytes += node->belief.Bytes();
+  m_lru.push_front(node);
+  node->lru = m_lru.begin();
+
+  // Never evicts the belief just stored
+  while (m_bytes > m_budget && m_lru.size() > 1) {
+    Evict();
+  }
+}
+
+void BeliefCache::Clear() {
+  for (map<double, Node *>::iterator it = m_roots.begin(); \
+      it != m_roots.end(); ++it) {
+    Free(it->second);
+  }
+
+  m_roots.clear();
+  m_lru.clear();
+  m_bytes = 0;
+}
+
+void BeliefCache::Evict() {
+  Node *node = m_lru.back();
+
+  m_lru.pop_back();
+  m_bytes -= node->belief.Bytes();
+  ++m_evictions;
+
+  node->cached = false;
+  vector<double>().swap(node->belief.joint);
+  vector<pair<int, double> >().swap(node->belief.active);
+
+  // Removes nodes no longer leading to a belief
+  while (node != NULL && !node->cached) {
+    for (int x = 0; x < 16; ++x) {
+      if (node->children[x] != NULL) {
+        return;
+      }
+    }
+
+    Node *parent = node->parent;
+
+    if (parent == NULL) {
+      for (map<double, Node *>::iterator it = m_roots.begin(); \
+          it != m_roots.end(); ++it) {
+        if (it->second == node) {
+          m_roots.erase(it);
+
+          break;
+        }
+      }
+    } else {
+      parent->children[node->obs] = NULL;
+    }
+
+    delete node;
+    m_bytes -= sizeof(Node);
+
+    node = parent;
+  }
+}
+
+BeliefCache::Node *BeliefCache::AddChild(Node *node, int obs) {
+  Node *child = new Node();
+
+  child->parent = node;
+  child->obs = obs;
+  child->cached = false;
+  memset(child->children, 0, sizeof(child->children));
+
+  if (node != NULL) {
+    node->children[obs] = child;
+  }
+
+  m_bytes += sizeof(Node);
+
+  return child;
+}
+
+void BeliefCache::Free(Node *node) {
+  for (int x = 0; x < 16; ++x) {
+    if (node->children[x] != NULL) {
+      Free(node->children[x]);
+    }
+  }
+
+  delete node;
+}
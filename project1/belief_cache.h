@@ -0,0 +1,93 @@
+#ifndef PROJECT1_BELIEF_CACHE_H_
+#define PROJECT1_BELIEF_CACHE_H_
+
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Filter state after a prefix of observations, either the joint matrix
+// or the sparse list of plausible states and their probabilities
+struct CachedBelief {
+  bool sparse;
+  std::vector<double> joint;
+  std::vector<std::pair<int, double> > active;
+
+  // Returns bytes held by the belief
+  size_t Bytes() const;
+};
+
+// Bounded cache of beliefs keyed by error and observation prefix
+//
+// Example usage:
+// BeliefCache cache(256 << 20);
+// const CachedBelief *belief;
+// int depth = cache.Find(error, &obs[0], obs.size(), &belief);
+// ... resume filtering from obs[depth] ...
+// cache.Insert(error, &obs[0], length, belief);
+//
+// Prefixes form a trie per error with one child per observation so a
+// lookup walks the sequence once. Beliefs are evicted least recently
+// used first once their bytes and the trie's exceed the budget
+class BeliefCache {
+  public:
+    explicit BeliefCache(size_t budget);
+    ~BeliefCache();
+
+    // Returns the length of the longest cached prefix of the length
+    // observations obs under error, 0 when none is cached
+    //
+    // The prefix's belief is stored in belief and stays valid until the
+    // next Insert
+    int Find(double error, const int *obs, int length, \
+        const CachedBelief **belief);
+    // Stores belief as the state after the length observations obs
+    // under error, replacing any belief cached for that prefix
+    //
+    // The contents of belief are moved into the cache
+    void Insert(double error, const int *obs, int length, \
+        CachedBelief *belief);
+    // Drops every cached belief, keeping the budget and statistics
+    void Clear();
+
+    long Lookups() const { return m_lookups; }
+    long Hits() const { return m_hits; }
+    long Evictions() const { return m_evictions; }
+    size_t Bytes() const { return m_bytes; }
+    size_t Beliefs() const { return m_lru.size(); }
+
+  private:
+    struct Node {
+      Node *parent;
+      int obs;
+      Node *children[16];
+      bool cached;
+      CachedBelief belief;
+      // Position in m_lru when cached
+      std::list<Node *>::iterator lru;
+    };
+
+    size_t m_budget;
+    size_t m_bytes;
+    long m_lookups;
+    long m_hits;
+    long m_evictions;
+    // Trie root of each error
+    std::map<double, Node *> m_roots;
+    // Cached nodes, most recently used first
+    std::list<Node *> m_lru;
+
+    // Drops the least recently used belief and the trie nodes left
+    // without beliefs or children
+    void Evict();
+    // Creates child obs of node
+    Node *AddChild(Node *node, int obs);
+    // Frees node and its subtree
+    void Free(Node *node);
+
+    BeliefCache(const BeliefCache &);
+    BeliefCache &operator=(const BeliefCache &);
+};
+
+#endif // PROJECT1_BELIEF_CACHE_H_
@@ -0,0 +1,254 @@
+#include "grid_map.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdint.h>
+
+using namespace std;
+
+// Binary map header
+const char kMagic[4] = { 'R', 'M', 'A', 'P' };
+const uint32_t kVersion = 1;
+const size_t kHeaderSize = 16;
+
+// Reads little-endian 32 bit value
+static uint32_t ReadU32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Writes little-endian 32 bit value
+static void WriteU32(uint32_t value, unsigned char *p) {
+  for (int i = 0; i < 4; ++i) {
+    p[i] = (value >> (8 * i)) & 0xff;
+  }
+}
+
+GridMap::GridMap()
+  : m_width(0), m_height(0), m_cells(NULL), m_mapping(NULL),
+    m_mapping_size(0) {
+}
+
+GridMap::~GridMap() {
+  Clear();
+}
+
+int GridMap::Load(const char *file) {
+  char magic[sizeof(kMagic)] = { 0 };
+  ifstream ifs(file, ios::binary);
+
+  if (ifs.fail()) {
+    cerr << "Failed to open " << file << endl; 
+
+    return 1;
+  }
+
+  ifs.read(magic, sizeof(magic));
+  ifs.close();
+
+  Clear();
+
+  if (memcmp(magic, kMagic, sizeof(kMagic)) == 0) {
+    return MapBinary(file);
+  }
+
+  return ParseText(file);
+}
+
+int GridMap::WriteBinary(const char *file) const {
+  unsigned char header[kHeaderSize];
+  ofstream ofs(file, ios::binary);
+
+  if (ofs.fail()) {
+    cerr << "Failed to open " << file << endl; 
+
+    return 1;
+  }
+
+  memcpy(header, kMagic, sizeof(kMagic));
+  WriteU32(kVersion, header + 4);
+  WriteU32(m_width, header + 8);
+  WriteU32(m_height, header + 12);
+
+  ofs.write((const char *)header, kHeaderSize);
+  ofs.write((const char *)m_cells, States());
+  ofs.close();
+
+  if (ofs.fail()) {
+    cerr << "Failed to write " << file << endl; 
+
+    return 1;
+  }
+
+  return 0;
+}
+
+int GridMap::ParseText(const char *file) {
+  ifstream ifs(file, ios::binary);
+  string text((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+  int line(1), row_cells(0), value(-1);
+
+  ifs.close();
+
+  m_storage.reserve(text.size() / 2);
+
+  // Cells are appended as each token ends, rows end on a newline
+  for (size_t i = 0; i <= text.size(); ++i) {
+    char c = i < text.size() ? text[i] : '\n';
+
+    if (c >= '0' && c <= '9') {
+      value = (value < 0 ? 0 : value * 10) + (c - '0');
+
+      if (value > 0xf) {
+        cerr << file << ":" << line << ": Invalid cell" << endl;
+
+        return 1;
+      }
+
+      continue;
+    }
+
+    if (value >= 0) {
+      m_storage.push_back(value);
+
+      ++row_cells;
+
+      value = -1;
+    }
+
+    if (c == '\n') {
+      if (row_cells > 0) {
+        if (m_height == 0) {
+          m_width = row_cells;
+        } else if (row_cells != m_width) {
+          cerr << file << ":" << line << ": Expected " << m_width
+               << " cells" << endl;
+
+          return 1;
+        }
+
+        ++m_height;
+      }
+
+      row_cells = 0;
+
+      ++line;
+    } else if (c != ' ' && c != '\t' && c != '\r') {
+      cerr << file << ":" << line << ": Unexpected character" << endl;
+
+      return 1;
+    }
+  }
+
+  if (m_height == 0) {
+    cerr << file << ": Empty map" << endl;
+
+    return 1;
+  }
+
+  m_cells = &m_storage[0];
+
+  return 0;
+}
+
+int GridMap::MapBinary(const char *file) {
+  struct stat st;
+  int fd = open(file, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    cerr << "Failed to open " << file << endl; 
+
+    if (fd >= 0) {
+      close(fd);
+    }
+
+    return 1;
+  }
+
+  void *mapping = NULL;
+
+  if (st.st_size >= (off_t)kHeaderSize) {
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+
+  if (mapping == NULL || mapping == MAP_FAILED) {
+    cerr << "Failed to map " << file << endl;
+
+    return 1;
+  }
+
+  const unsigned char *header = (const unsigned char *)mapping;
+
+  m_mapping = mapping;
+  m_mapping_size = st.st_size;
+  m_width = ReadU32(header + 8);
+  m_height = ReadU32(header + 12);
+
+  if (ReadU32(header + 4) != kVersion || m_width <= 0 || m_height <= 0 || \
+      (size_t)(st.st_size - kHeaderSize) / m_width < (size_t)m_height) {
+    cerr << file << ": Invalid binary map" << endl;
+
+    Clear();
+
+    return 1;
+  }
+
+  m_cells = header + kHeaderSize;
+
+  for (int x = 0; x < States(); ++x) {
+    if (m_cells[x] > 0xf) {
+      cerr << file << ": Invalid cell " << x << endl;
+
+      Clear();
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int GridMap::Set(int row, int col, int mask) {
+  if (row < 0 || row >= m_height || col < 0 || col >= m_width || \
+      mask < 0 || mask > 0xf) {
+    cerr << "Invalid cell edit " << row << " " << col << " " << mask
+         << endl;
+
+    return 1;
+  }
+
+  // Copies the mapping on first write
+  if (m_mapping != NULL) {
+    m_storage.assign(m_cells, m_cells + States());
+
+    munmap(m_mapping, m_mapping_size);
+
+    m_mapping = NULL;
+    m_mapping_size = 0;
+    m_cells = &m_storage[0];
+  }
+
+  m_storage[row * m_width + col] = mask;
+
+  return 0;
+}
+
+void GridMap::Clear() {
+  if (m_mapping != NULL) {
+    munmap(m_mapping, m_mapping_size);
+  }
+
+  m_storage.clear();
+  m_mapping = NULL;
+  m_mapping_size = 0;
+  m_cells = NULL;
+  m_width = m_height = 0;
+}
@@ -0,0 +1,74 @@
+#ifndef PROJECT1_GRID_MAP_H_
+#define PROJECT1_GRID_MAP_H_
+
+#include <stddef.h>
+#include <vector>
+
+// Map of NSWE obstacle masks stored one byte per cell, row-major
+//
+// Maps are loaded from either format:
+//
+// Text, one row per line
+// 10 12 9
+// 7  15 7
+//
+// Binary, little-endian
+// [0, 4)   - Magic "RMAP"
+// [4, 8)   - Version, currently 1
+// [8, 12)  - Width
+// [12, 16) - Height
+// [16, ..) - Width*height cell bytes, row-major
+//
+// Binary maps are memory-mapped and used in place without copying
+class GridMap {
+  public:
+    GridMap();
+    ~GridMap();
+
+    // Returns true on success
+    //
+    // Loads map from file detecting its format
+    int Load(const char *file);
+    // Returns true on success
+    //
+    // Writes map to file in the binary format
+    int WriteBinary(const char *file) const;
+
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+    int States() const { return m_width * m_height; }
+    // Returns the cells, row-major
+    const unsigned char *Cells() const { return m_cells; }
+    // Returns mask of the cell at row and column
+    int At(int row, int col) const { return m_cells[row * m_width + col]; }
+    // Returns true on success
+    //
+    // Sets mask of the cell at row and column, memory-mapped maps are
+    // copied to memory on the first edit and the file left untouched
+    int Set(int row, int col, int mask);
+
+  private:
+    int m_width;
+    int m_height;
+    // Points into m_storage for text maps or the mapping for binary maps
+    const unsigned char *m_cells;
+    std::vector<unsigned char> m_storage;
+    void *m_mapping;
+    size_t m_mapping_size;
+
+    // Returns true on success
+    //
+    // Parses text map in a single pass over the file contents
+    int ParseText(const char *file);
+    // Returns true on success
+    //
+    // Memory-maps binary map
+    int MapBinary(const char *file);
+    // Releases the current map
+    void Clear();
+
+    GridMap(const GridMap &);
+    GridMap &operator=(const GridMap &);
+};
+
+#endif // PROJECT1_GRID_MAP_H_
@@ -0,0 +1,131 @@
+#include "map_generator.h"
+
+#include <stdio.h>
+#include <iostream>
+
+#include "mask.h"
+
+using namespace std;
+
+// Probability of a wall between two open neighbors
+const double kWallProbability = 0.2;
+
+MapGenerator::MapGenerator(uint32_t seed) : m_random(seed) {
+}
+
+void MapGenerator::GenerateMap(int height, int width, double density, \
+    vector<unsigned char> *cells) {
+  int states = height * width;
+  vector<bool> open(states);
+
+  cells->assign(states, 0);
+
+  for (int x = 0; x < states; ++x) {
+    open[x] = Uniform() < density;
+  }
+
+  // Each wall is decided once and set on both cells it separates
+  for (int x = 0; x < height; ++x) {
+    for (int y = 0; y < width; ++y) {
+      int index = x*width+y;
+
+      if (!open[index]) {
+        (*cells)[index] = 0xf;
+
+        continue;
+      }
+
+      if (x == 0 || !open[index-width]) {
+        (*cells)[index] |= NORTH;
+      }
+
+      if (y == 0 || !open[index-1]) {
+        (*cells)[index] |= WEST;
+      }
+
+      if (x == height-1 || !open[index+width]) {
+        (*cells)[index] |= SOUTH;
+      } else if (Uniform() < kWallProbability) {
+        (*cells)[index] |= SOUTH;
+        (*cells)[index+width] |= NORTH;
+      }
+
+      if (y == width-1 || !open[index+1]) {
+        (*cells)[index] |= EAST;
+      } else if (Uniform() < kWallProbability) {
+        (*cells)[index] |= EAST;
+        (*cells)[index+1] |= WEST;
+      }
+    }
+  }
+}
+
+void MapGenerator::SimulateWalk(const vector<unsigned char> &cells, \
+    int width, int steps, double error, vector<int> *path, \
+    vector<int> *obs) {
+  int state;
+  vector<int> start;
+
+  path->clear();
+  obs->clear();
+
+  // Starts on a cell the robot can leave
+  for (int x = 0; x < cells.size(); ++x) {
+    if (cells[x] != 0xf) {
+      start.push_back(x);
+    }
+  }
+
+  if (start.empty()) {
+    return;
+  }
+
+  state = start[m_random() % start.size()];
+
+  for (int t = 0; t < steps; ++t) {
+    int mask = cells[state];
+    // Cells that are not walls always have an open side
+    int side = kOpenSide[mask][m_random() % kOpenSides[mask]];
+
+    state += side == NORTH ? -width : side == SOUTH ? width : \
+        side == WEST ? -1 : 1;
+
+    int value = cells[state];
+
+    for (int d = 0; d < 4; ++d) {
+      if (Uniform() < error) {
+        value ^= NORTH >> d;
+      }
+    }
+
+    path->push_back(state);
+    obs->push_back(value);
+  }
+}
+
+int MapGenerator::WriteText(const char *file, int height, int width, \
+    const vector<unsigned char> &cells) {
+  FILE *out = fopen(file, "w");
+
+  if (out == NULL) {
+    cerr << "Failed to open " << file << endl;
+
+    return 1;
+  }
+
+  for (int x = 0; x < height; ++x) {
+    for (int y = 0; y < width; ++y) {
+      fprintf(out, y == 0 ? "%d" : " %d", cells[x*width+y]);
+    }
+
+    fputc('\n', out);
+  }
+
+  fclose(out);
+
+  return 0;
+}
+
+double MapGenerator::Uniform() {
+  return uniform_real_distribution<double>(0, 1)(m_random);
+}
@@ -0,0 +1,50 @@
+#ifndef PROJECT1_MAP_GENERATOR_H_
+#define PROJECT1_MAP_GENERATOR_H_
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+// Random maps and robot walks for benchmarking
+//
+// Example usage:
+// MapGenerator gen(seed);
+// vector<unsigned char> cells;
+// gen.GenerateMap(100, 100, 0.8, &cells);
+// gen.WriteText("map.txt", 100, 100, cells);
+// gen.SimulateWalk(cells, 100, 50, 0.1, &path, &obs);
+//
+// Cells use the NSWE masks of the map format, a wall between two cells
+// is set on both of them and the border of the map is walled
+class MapGenerator {
+  public:
+    explicit MapGenerator(uint32_t seed);
+
+    // Generates a height by width map whose cells are open with
+    // probability density, walls between open neighbors are added with
+    // probability kWallProbability
+    void GenerateMap(int height, int width, double density, \
+        std::vector<unsigned char> *cells);
+    // Simulates a robot moving steps times from a random open cell,
+    // each move picks an open side uniformly as the filter assumes
+    //
+    // Stores the state after each move in path and the observation of
+    // it in obs, every side of an observation is flipped with
+    // probability error, the walled border keeps the walk on the map
+    void SimulateWalk(const std::vector<unsigned char> &cells, int width, \
+        int steps, double error, std::vector<int> *path, \
+        std::vector<int> *obs);
+    // Returns true on success
+    //
+    // Writes cells as a text map
+    int WriteText(const char *file, int height, int width, \
+        const std::vector<unsigned char> &cells);
+
+  private:
+    std::mt19937 m_random;
+
+    // Returns a uniform random number in [0, 1)
+    double Uniform();
+};
+
+#endif // PROJECT1_MAP_GENERATOR_H_
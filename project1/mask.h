@@ -0,0 +1,92 @@
+#ifndef PROJECT1_MASK_H_
+#define PROJECT1_MASK_H_
+
+// Sides blocked by an obstacle in a 4 bit state or observation mask
+#define NORTH   0x8
+#define SOUTH   0x4
+#define WEST    0x2
+#define EAST    0x1
+
+// Per mask quantities evaluated at compile time, so map preprocessing
+// is a table lookup per cell instead of a loop over its four bits
+//
+// Example usage:
+// int paths = kOpenSides[cell];
+// int diff = kMaskDistance[obs][state];
+
+// Returns the number of blocked sides of mask
+constexpr int BlockedSides(int mask) {
+  return (mask & 0x1) + ((mask >> 1) & 0x1) + ((mask >> 2) & 0x1) + \
+      ((mask >> 3) & 0x1);
+}
+
+// Returns the number of open sides of mask
+constexpr int OpenSides(int mask) {
+  return 4 - BlockedSides(mask & 0xf);
+}
+
+// Returns the probability of each move out of mask, 0 without open sides
+constexpr double MoveProbability(int mask) {
+  return OpenSides(mask) > 0 ? 1.0 / OpenSides(mask) : 0.0;
+}
+
+// Returns the number of sides on which two masks differ
+constexpr int MaskDistance(int a, int b) {
+  return BlockedSides(a ^ b);
+}
+
+// Returns the nth open side of mask in NSWE order, searching from side
+// downwards, or 0 when mask has no nth open side
+constexpr int NthOpenSide(int mask, int n, int side = NORTH) {
+  return side == 0 ? 0 :
+      (mask & side) != 0x0 ? NthOpenSide(mask, n, side >> 1) :
+      n == 0 ? side : NthOpenSide(mask, n - 1, side >> 1);
+}
+
+// Expands f over the 16 masks
+#define MASK_TABLE(f) { \
+    f(0), f(1), f(2), f(3), f(4), f(5), f(6), f(7), f(8), f(9), f(10), \
+    f(11), f(12), f(13), f(14), f(15) }
+
+// Expands f over the 16 masks after a leading mask a
+#define MASK_ROW(f, a) { \
+    f(a, 0), f(a, 1), f(a, 2), f(a, 3), f(a, 4), f(a, 5), f(a, 6), \
+    f(a, 7), f(a, 8), f(a, 9), f(a, 10), f(a, 11), f(a, 12), f(a, 13), \
+    f(a, 14), f(a, 15) }
+
+#define MASK_OPEN_SIDES(mask) { \
+    NthOpenSide(mask, 0), NthOpenSide(mask, 1), NthOpenSide(mask, 2), \
+    NthOpenSide(mask, 3) }
+
+// Open sides of each mask
+constexpr int kOpenSides[16] = MASK_TABLE(OpenSides);
+
+// Probability of each move out of a state with the mask
+constexpr double kMoveProbability[16] = MASK_TABLE(MoveProbability);
+
+// Open sides of each mask in NSWE order, the first kOpenSides are used
+constexpr int kOpenSide[16][4] = MASK_TABLE(MASK_OPEN_SIDES);
+
+// Sides on which an observation and a state differ
+constexpr int kMaskDistance[16][16] = {
+  MASK_ROW(MaskDistance, 0), MASK_ROW(MaskDistance, 1),
+  MASK_ROW(MaskDistance, 2), MASK_ROW(MaskDistance, 3),
+  MASK_ROW(MaskDistance, 4), MASK_ROW(MaskDistance, 5),
+  MASK_ROW(MaskDistance, 6), MASK_ROW(MaskDistance, 7),
+  MASK_ROW(MaskDistance, 8), MASK_ROW(MaskDistance, 9),
+  MASK_ROW(MaskDistance, 10), MASK_ROW(MaskDistance, 11),
+  MASK_ROW(MaskDistance, 12), MASK_ROW(MaskDistance, 13),
+  MASK_ROW(MaskDistance, 14), MASK_ROW(MaskDistance, 15)
+};
+
+#undef MASK_OPEN_SIDES
+#undef MASK_ROW
+#undef MASK_TABLE
+
+// Checks the tables against masks worked out by hand
+static_assert(kOpenSides[0xa] == 2, "NW leaves S and E open");
+static_assert(kOpenSides[0xf] == 0, "NSWE is a wall");
+static_assert(kMaskDistance[0xa][0xc] == 2, "NW and NS differ on S and W");
+static_assert(kOpenSide[0x9][1] == WEST, "NE opens S then W");
+
+#endif  // PROJECT1_MASK_H_
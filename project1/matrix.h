@@ -0,0 +1,59 @@
+#ifndef PROJECT1_MATRIX_H_
+#define PROJECT1_MATRIX_H_
+
+#include <algorithm>
+#include <vector>
+
+// Row-major matrix stored in one contiguous block
+//
+// Example usage:
+// Matrix<double> m(rows, cols);
+// m(row, col) = 1;
+// double *r = m.Row(row);
+//
+// Resizing to a size that fits the current capacity does not allocate,
+// so matrices reused across steps allocate only once
+template<typename T>
+class Matrix {
+  public:
+    Matrix() : m_rows(0), m_cols(0) {}
+    Matrix(int rows, int cols, T value = T()) {
+      Resize(rows, cols, value);
+    }
+
+    // Resizes matrix setting every element to value
+    void Resize(int rows, int cols, T value = T()) {
+      m_rows = rows;
+      m_cols = cols;
+      m_data.assign((size_t)rows * cols, value);
+    }
+
+    int Rows() const { return m_rows; }
+    int Cols() const { return m_cols; }
+    // Returns number of elements
+    size_t Size() const { return m_data.size(); }
+
+    T &operator()(int row, int col) {
+      return m_data[(size_t)row * m_cols + col];
+    }
+    const T &operator()(int row, int col) const {
+      return m_data[(size_t)row * m_cols + col];
+    }
+
+    // Returns pointer to first element of row
+    T *Row(int row) { return &m_data[(size_t)row * m_cols]; }
+    const T *Row(int row) const { return &m_data[(size_t)row * m_cols]; }
+
+    void Swap(Matrix &m) {
+      std::swap(m_rows, m.m_rows);
+      std::swap(m_cols, m.m_cols);
+      m_data.swap(m.m_data);
+    }
+
+  private:
+    int m_rows;
+    int m_cols;
+    std::vector<T> m_data;
+};
+
+#endif // PROJECT1_MATRIX_H_
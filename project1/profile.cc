@@ -0,0 +1,108 @@
+#include "profile.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include <vector>
+
+using namespace std;
+
+#ifdef ROBOT_PROFILE
+
+namespace {
+
+// Bytes allocated through operator new by every thread
+atomic<long> g_allocated(0);
+
+mutex &PhasesMutex() {
+  static mutex phases_mutex;
+
+  return phases_mutex;
+}
+
+vector<ProfilePhase *> &Phases() {
+  static vector<ProfilePhase *> phases;
+
+  return phases;
+}
+
+}  // namespace
+
+void *operator new(size_t size) {
+  void *p = malloc(size == 0 ? 1 : size);
+
+  if (p == NULL) {
+    throw bad_alloc();
+  }
+
+  g_allocated += size;
+
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+ProfilePhase::ProfilePhase(const char *name)
+  : m_name(name), m_calls(0), m_nanos(0), m_bytes(0) {
+  lock_guard<mutex> lock(PhasesMutex());
+
+  Phases().push_back(this);
+}
+
+ProfileScope::ProfileScope(ProfilePhase *phase)
+  : m_phase(phase), m_start(chrono::steady_clock::now()),
+    m_bytes(g_allocated) {
+}
+
+ProfileScope::~ProfileScope() {
+  chrono::steady_clock::duration elapsed = \
+      chrono::steady_clock::now() - m_start;
+
+  ++m_phase->m_calls;
+  m_phase->m_nanos += \
+      chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+  m_phase->m_bytes += g_allocated - m_bytes;
+}
+
+int WriteProfile(const char *file) {
+  ofstream ofs(file);
+
+  if (ofs.fail()) {
+    cerr << "Failed to open " << file << endl;
+
+    return 1;
+  }
+
+  lock_guard<mutex> lock(PhasesMutex());
+
+  ofs << "{\"phases\": [";
+
+  // Phases appear in the order they first ran
+  for (int x = 0; x < Phases().size(); ++x) {
+    ProfilePhase *phase = Phases()[x];
+
+    ofs << (x == 0 ? "" : ",") << "\n  {\"name\": \"" << phase->m_name
+        << "\", \"calls\": " << phase->m_calls << ", \"seconds\": "
+        << fixed << setprecision(9) << phase->m_nanos / 1e9
+        << ", \"bytes\": " << phase->m_bytes << "}";
+  }
+
+  ofs << "\n]}" << endl;
+
+  return 0;
+}
+
+#else
+
+int WriteProfile(const char *) {
+  cerr << "Profiling is disabled, rebuild with make PROFILE=1" << endl;
+
+  return 1;
+}
+
+#endif // ROBOT_PROFILE
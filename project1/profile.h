@@ -0,0 +1,68 @@
+#ifndef PROJECT1_PROFILE_H_
+#define PROJECT1_PROFILE_H_
+
+// Per-phase wall time, call count and allocation counters
+//
+// Example usage:
+// void Robot::Filter(int obs) {
+//   PROFILE_SCOPE("Filter");
+//   ...
+// }
+//
+// Counters are only compiled in when ROBOT_PROFILE is defined, e.g.
+// make clean && make PROFILE=1, otherwise PROFILE_SCOPE expands to
+// nothing. Times and bytes of nested phases are included in the phases
+// around them, bytes count every allocation made by the process while
+// the phase runs
+//
+// Each mode's entry point and its per-step function are phases, so every
+// mode reports where its time goes
+#ifdef ROBOT_PROFILE
+
+#include <atomic>
+#include <chrono>
+
+// Counters of one phase, registered on construction
+class ProfilePhase {
+  public:
+    explicit ProfilePhase(const char *name);
+
+    const char *m_name;
+    std::atomic<long> m_calls;
+    std::atomic<long> m_nanos;
+    std::atomic<long> m_bytes;
+};
+
+// Adds the time and bytes allocated between construction and
+// destruction to a phase
+class ProfileScope {
+  public:
+    explicit ProfileScope(ProfilePhase *phase);
+    ~ProfileScope();
+
+  private:
+    ProfilePhase *m_phase;
+    std::chrono::steady_clock::time_point m_start;
+    long m_bytes;
+};
+
+#define PROFILE_SCOPE(name) \
+  static ProfilePhase profile_phase_(name); \
+  ProfileScope profile_scope_(&profile_phase_)
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+#endif // ROBOT_PROFILE
+
+// Returns true on success
+//
+// Writes the counters of every phase that ran to file as JSON
+// {"phases": [{"name": "Filter", "calls": 3, "seconds": 0.000012,
+//   "bytes": 0}, ...]}
+//
+// Fails when built without ROBOT_PROFILE
+int WriteProfile(const char *file);
+
+#endif // PROJECT1_PROFILE_H_
@@ -5,21 +5,85 @@
 #include <iomanip>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "belief_cache.h"
+#include "grid_map.h"
+#include "map_generator.h"
+#include "mask.h"
+#include "matrix.h"
+#include "profile.h"
+#include "thread_pool.h"
 
 using namespace std;
 
-#define NORTH   0x8
-#define SOUTH   0x4
-#define WEST    0x2
-#define EAST    0x1
+// States per tile of the belief update, sized so a tile of the joint
+// matrix, prediction buffer and observation plane stays in cache
+const int kTileStates = 1 << 14;
+
+// Sequences advanced together in batch mode, their probabilities for a
+// state are adjacent in memory so a step vectorizes across sequences
+const int kBatchLanes = 4;
+
+// Float beliefs are renormalized once their total drops below this, far
+// enough above the smallest normal float that unlikely states survive
+const double kFloatRenormalize = 1e-20;
+
+// Observations between beliefs stored in the cache, the belief after a
+// whole sequence is always stored
+const int kCacheInterval = 4;
+
+// Benchmark maps range from 100 cells to --bench-cells in powers of
+// ten, each generated at every density with a walk of kBenchSteps
+// observations made with sensor error kBenchError
+const int kBenchDensities = 2;
+const double kBenchDensity[kBenchDensities] = { 1.0, 0.7 };
+const int kBenchSteps = 30;
+const double kBenchError = 0.1;
+
+// Requests sharing a map and error answered together by a server worker
+const int kServerBatch = 4 * kBatchLanes;
+
+// Two bit backpointer codes of the Viterbi decoder giving the direction
+// of the previous state
+enum Backpointer {
+  FROM_NORTH = 0,
+  FROM_SOUTH = 1,
+  FROM_WEST = 2,
+  FROM_EAST = 3
+};
 
-// Type alias defined in c++11
-// http://en.cppreference.com/w/cpp/language/type_alias
-template<typename T>
-using Matrix = vector<vector<T> >;
+// Backpointers packed into each byte
+const int kBackpointersPerByte = 4;
+
+// The filter switches to a sparse list of plausible states once at most
+// 1/kSparseFraction of the states remain, and back to the joint matrix
+// once more than 1/kDenseFraction do
+const int kSparseFraction = 16;
+const int kDenseFraction = 8;
+
+// Probabilities within this relative distance of the highest one are
+// reported as ties
+const double kTieTolerance = 1e-9;
 
-#define Matrix(t, n, w, h) Matrix<t> n(h, vector<t>(w, 0))
-#define PMatrix(t, n, w, h) new Matrix<t>(h, vector<t>(w, 0)) 
+// Particles moved and weighted per task of the particle filter
+const int kParticleChunk = 1 << 12;
 
 // Determines robots probable location based on given observations
 // Map definition:
@@ -33,38 +97,503 @@ using Matrix = vector<vector<T> >;
 // Observations follow the same format as the map definition
 class Robot {
   public:
+    Robot();
+
     // Initializes robot, requires arguments as follows
-    // [1]        - File containing map data
-    // [2]        - Sensor error
-    // [3]...[x]  - List of observations
+    // [1]...[n]  - Options e.g. --stream, --batch <file>, --smooth,
+    //              --viterbi, --memory <MB>, --obs <file>,
+    //              --threads <count>, --convert <file>,
+    //              --prune <threshold>, --top <k>,
+    //              --particles <count>, --seed <seed>, --compare,
+    //              --pyramid <levels>, --refine <threshold>,
+    //              --server, --socket <path>, --profile <file>,
+    //              --float, --cache <MB>,
+    //              --sweep <min> <max> <count>,
+    //              --bench <prefix>, --bench-cells <cells>
+    // [n+1]      - File containing map data
+    // [n+2]      - Sensor error, not needed by --convert
+    // [n+3]...[x]- List of observations
+    //
+    // With --server the positional arguments are <name>=<map file>
+    // pairs instead, --sweep takes no sensor error and --bench takes no
+    // positional arguments
     int Init(int argc, char **argv);
+    // Runs the mode selected by the options given to Init then writes
+    // the --profile report
+    int Run();
     // Determines robots probable position and prints the results
     // as a coordinate and probability
+    //
+    // With --top the k most probable states are printed instead
     int Localize();
+    // Reads observations one per line from is and prints the most
+    // probable positions after each one
+    //
+    // Output lines look as follows
+    // <step> (row,col)... probability
+    //
+    // With --top the k most probable states are printed instead
+    // <step> (row,col) probability (row,col) probability...
+    //
+    // A line 'edit <row> <col> <mask>' changes the mask of a cell, the
+    // filter continues from its current belief
+    int Stream(istream &is);
+    // Returns true on success
+    //
+    // Sets the NSWE mask of the cell at row and column, updating the
+    // transition stencil of the cell and its neighbors and the cell's
+    // observation plane entries. Outside stream mode the prior is rebuilt
+    // for the edited map, a stream keeps its belief. Cached beliefs are
+    // dropped
+    int EditCell(int row, int col, int mask);
+    // Localizes every sequence read from the batch file against the
+    // map and prints one line per sequence in input order
+    //
+    // Output lines look as follows
+    // <sequence> (row,col)... probability
+    //
+    // With --cache sequences run one after another, each resuming from
+    // the belief of its longest prefix seen before
+    int Batch();
+    // Computes the smoothed position distribution at every step given
+    // all observations and prints the most likely states of each step
+    //
+    // Forward vectors are only kept at every sqrt(T)th step and the
+    // rest recomputed segment by segment during the backward pass, so
+    // memory is O(sqrt(T)) vectors instead of O(T)
+    //
+    // Output lines look as follows
+    // <step> (row,col)... probability
+    int Smooth();
+    // Decodes the single most likely path of the robot given all
+    // observations and prints the state of every step
+    //
+    // Runs in log space storing a 2 bit backpointer per state and step.
+    // When T*states/4 bytes exceed the --memory budget only every Kth
+    // score vector and one segment of backpointers are kept, segments
+    // being recomputed from their checkpoint during traceback
+    //
+    // Output lines look as follows
+    // <step> (row,col)
+    int Viterbi();
+    // Determines robots probable position with a particle filter and
+    // prints the results as Localize does
+    //
+    // Particles move and are weighted with the same map and sensor
+    // model as the grid filter and are resampled systematically
+    // whenever the effective sample size drops below half the count
+    int LocalizeParticles();
+    // Determines robots probable position coarse to fine and prints the
+    // results as Localize does
+    //
+    // The map is summarized into blocks of 2^levels by 2^levels cells,
+    // the coarse level is smoothed over every observation and only the
+    // blocks holding a fraction --refine of the most likely block's
+    // mass, plus their neighbors, are filtered at full resolution
+    int LocalizePyramid();
+    // Determines robots probable position as Localize does holding the
+    // joint matrix, move probabilities and observation planes in float,
+    // halving the memory traffic of each step
+    //
+    // The joint matrix is renormalized whenever its total drops below
+    // kFloatRenormalize so it does not underflow. Only the dense filter
+    // runs in float, --prune is ignored
+    int LocalizeFloat();
+    // Runs the filter once for each of the --sweep sensor errors and
+    // prints the log likelihood of the observations and most likely
+    // states under each, followed by the maximum likelihood error
+    //
+    // Output lines look as follows
+    // <error> <log likelihood> (row,col)... probability
+    // best <error>
+    //
+    // The candidates share the map tables and advance together, their
+    // probabilities for a state adjacent in memory as in batch mode
+    int Sweep();
+    // Generates random maps and noisy walks of growing size, times map
+    // parsing, model construction, filter steps and the final argmax on
+    // each and records whether the robot's true state was found
+    //
+    // Results are written to <prefix>.csv and <prefix>.json
+    int Bench();
+    // Preloads the maps given to --server and answers localization
+    // requests until shutdown, read line by line from stdin or from
+    // every client of the --socket Unix domain socket
+    //
+    // Request lines look as follows
+    // <id> <map name> <error> <obs1> <obs2>...
+    //
+    // Answers follow the batch output, in completion order
+    // <id> (row,col)... probability
+    //
+    // Cells are edited with the line below, answered by '<id> ok' once
+    // requests for the map queued before it are answered
+    // <id> edit <map name> <row> <col> <mask>
+    //
+    // Queued requests sharing a map and error are answered together by
+    // one of --threads workers. A shutdown line or the end of stdin
+    // stops the server once queued requests are answered, later requests
+    // are answered '<id> error shutting down'. Latency percentiles are
+    // printed on stderr
+    //
+    // With --cache every map keeps a belief cache of that size and
+    // answers requests one by one from their longest cached prefix
+    int Serve();
 
   private:
+    // Client of the server, stdin and stdout in line mode
+    struct Connection {
+      Connection(int in, int out) : in(in), out(out), pending(0), \
+          reading(true) { }
+
+      int in;
+      int out;
+      // Queued requests not yet answered and whether requests may
+      // still arrive, the connection closes once neither holds
+      int pending;
+      bool reading;
+      // Serializes answers written by different workers
+      mutex lock;
+    };
+
+    struct Request {
+      string id;
+      Robot *robot;
+      double error;
+      // Observations, or row, column and mask of an edit
+      vector<int> obs;
+      bool edit;
+      Connection *conn;
+      chrono::steady_clock::time_point arrival;
+    };
+
+    enum Mode {
+      LOCALIZE,
+      STREAM,
+      BATCH,
+      SMOOTH,
+      VITERBI,
+      CONVERT,
+      PARTICLES,
+      PYRAMID,
+      SERVER,
+      FLOAT,
+      SWEEP,
+      BENCH
+    };
+
+    Mode m_mode;
+    // JSON report of per-phase counters written by Run, see profile.h
+    const char *m_profile;
     double m_error; 
-    Matrix<int> m_map; 
+    GridMap m_map; 
     vector<int> m_obs; 
-
+    // Binary map written in convert mode
+    const char *m_convert;
+    // Observation sequences of batch mode
+    vector<vector<int> > m_sequences;
+    // Joint matrix and prediction buffer, reused across steps
+    vector<double> m_joint;
+    vector<double> m_predict;
+    // Single precision joint matrix and prediction buffer of --float
+    vector<float> m_joint_f;
+    vector<float> m_predict_f;
+    // States whose probability is below this fraction of the highest
+    // are pruned by the filter, 0 keeps every state
+    double m_prune;
+    // Number of states reported by --top, 0 reports the most likely
+    int m_top;
+    // Whether the filter holds its belief in m_active rather than
+    // m_joint, m_predict is kept zeroed to accumulate sparse steps
+    bool m_sparse;
+    // Plausible states and their probabilities in index order
+    vector<pair<int, double> > m_active;
+    // States reached by the current sparse step
+    vector<int> m_touched;
+    // Whether approximate modes report their error against the grid
+    // filter on stderr
+    bool m_compare;
+    // Particles stored as structure-of-arrays with a resampling buffer
+    int m_particles;
+    uint64_t m_seed;
+    vector<int> m_particle_state;
+    vector<double> m_particle_weight;
+    vector<int> m_resampled;
+    // Pyramid levels above the map and the fraction of the most likely
+    // block's mass a block needs to be refined
+    int m_levels;
+    double m_refine;
+    // Coarse level dimensions, prior, probability of staying in a block
+    // and of crossing to each neighbor in N, W, E, S order, and p(obs)
+    // averaged over the cells of a block with one row per observation
+    int m_coarse_width;
+    int m_coarse_height;
+    vector<double> m_coarse_prior;
+    vector<double> m_coarse_stay;
+    Matrix<double> m_coarse_cross;
+    Matrix<double> m_coarse_planes;
+    // Maps preloaded by the server keyed by name, each held by a robot
+    // of its own answering one batch at a time
+    vector<pair<string, const char *> > m_map_files;
+    map<string, unique_ptr<Robot> > m_servers;
+    const char *m_socket;
+    int m_listener;
+    // Clients, queued requests and the robots busy answering a batch,
+    // all guarded by m_queue_mutex
+    vector<unique_ptr<Connection> > m_connections;
+    deque<Request> m_queue;
+    set<Robot *> m_busy;
+    mutex m_queue_mutex;
+    condition_variable m_queue_ready;
+    atomic<bool> m_closing;
+    // Sensor errors evaluated by --sweep
+    vector<double> m_sweep_errors;
+    // Output prefix and largest map of --bench
+    const char *m_bench;
+    long m_bench_cells;
+    // Beliefs of observation prefixes seen before, with the number of
+    // steps resumed from the cache and of steps requested
+    unique_ptr<BeliefCache> m_cache;
+    size_t m_cache_budget;
+    long m_cache_reused;
+    long m_cache_steps;
+    // Microseconds from arrival to answer of every request
+    vector<double> m_latencies;
+    int m_batches;
+    // Threads used by the belief update, 0 uses every hardware thread
+    int m_threads;
+    // Megabytes Viterbi may spend on backpointers before checkpointing
+    long m_memory;
+    unique_ptr<ThreadPool> m_pool;
+    // The map is split into tiles of whole rows processed in parallel
+    int m_tile_rows;
+    int m_tiles;
+    // Per tile sums, maxima and most likely states
+    //
+    // These are always combined in tile order so results do not
+    // depend on which thread processed a tile
+    vector<double> m_tile_sums;
+    vector<int> m_tile_counts;
+    vector<double> m_tile_max;
+    vector<vector<int> > m_tile_results;
+    // Viterbi backpointer code of each state before packing
+    vector<unsigned char> m_codes;
+    // Probability of each move out of a state, 1/valid paths
+    vector<double> m_move;
+    // NSWE mask of the neighbors able to move into a state
+    vector<unsigned char> m_inbound;
+    // NSWE mask of the neighbors a state can move into
+    vector<unsigned char> m_outbound;
+    // log p(move) indexed by state mask
+    double m_log_move[16];
+    // p(obs|state) and log p(obs|state) indexed by [obs][state]
+    double m_likelihood[16][16];
+    double m_log_likelihood[16][16];
+    // p(obs|state) of each state in the map, one row per observation
+    Matrix<double> m_planes;
+    // Single precision move probabilities and planes of --float
+    vector<float> m_move_f;
+    Matrix<float> m_planes_f;
+
+    // Initializes the joint matrix, transition stencil and observation
+    // planes
+    void InitModel();
+    // Sets the joint matrix to the uniform prior over states that are
+    // not walls
+    void InitPrior();
+    // Initializes the likelihood table, transition stencil, tiles and
+    // thread pool shared by every mode
+    void InitTables();
+    // Moves the robot then applies observation obs to the joint matrix
+    //
+    // Per tile sums, maxima and non-zero counts of the result are kept
+    void Step(int obs);
+    // Moves the robot then applies observation obs to joint matrix j
+    // using r as the prediction buffer, j holds the result afterwards
+    //
+    // Per tile sums, maxima and non-zero counts of the result are kept
+    template<typename T>
+    void StepDense(int obs, vector<T> *j, vector<T> *r);
+    // Initializes the float joint matrix, move probabilities and planes
+    // from the double ones built by InitTables
+    void InitFloatModel();
+    // Returns move probabilities and observation planes held as T
+    template<typename T>
+    const vector<T> &Moves() const;
+    template<typename T>
+    const Matrix<T> &Planes() const;
+    // Moves the robot then applies observation obs to the belief of the
+    // filter, switching between the joint matrix and the sparse list of
+    // plausible states as the probability mass spreads or concentrates
+    void Filter(int obs);
+    // Applies one step to the sparse list of plausible states
+    //
+    // Each plausible state pushes its probability to the neighbors it
+    // can move into, O(plausible states)
+    void StepSparse(int obs);
+    // Normalizes the belief of the filter
+    void NormalizeFilter();
+    // Returns the highest probability of the belief of the filter
+    //
+    // States sharing this probability are stored in results
+    double FindMostLikelyFilter(vector<int> *results);
+    // Stores the k most probable states of the belief of the filter in
+    // top ordered by decreasing probability
+    void FindTopK(int k, vector<pair<double, int> > *top);
+    // Returns the highest probability in joint matrix j
+    //
+    // States sharing this probability are stored in results, float
+    // matrices use a tie tolerance matching their precision
+    template<typename T>
+    double FindMostLikely(const vector<T> &j, vector<int> *results);
+    // Stores the range of states covered by a tile in begin and end
+    void TileBounds(int tile, int *begin, int *end);
+    // Prints a line with id, most likely states and their probability
+    void PrintResults(int id, double max, const vector<int> &results);
+    // Prints a line with id and results to os
+    void PrintResults(ostream &os, const string &id, double max, \
+        const vector<int> &results);
+    // Localizes every sequence storing the highest probability and the
+    // most likely states of each, m_joint must hold the prior
+    void FilterBatch(const vector<vector<int> > &sequences, \
+        vector<double> *maxes, vector<vector<int> > *results);
+    // Reads request lines from conn until it ends or shutdown
+    void ReadRequests(Connection *conn);
+    // Parses line and queues the request it holds, malformed requests
+    // are answered with an error right away
+    void QueueRequest(Connection *conn, const string &line);
+    // Worker loop answering batches of queued requests until shutdown
+    void AnswerRequests();
+    // Writes line to conn
+    void WriteLine(Connection *conn, const string &line);
+    // Closes conn once nothing is pending, requires m_queue_mutex
+    void FinishConnection(Connection *conn);
+    // Stops accepting requests and wakes workers
+    void Shutdown();
+    // Prints request count and latency percentiles to stderr
+    void PrintLatencies();
+    // Rebuilds likelihood table and observation planes for error
+    void SetError(double error);
+    // Runs the mode selected by the options given to Init
+    int RunMode();
+    // Moves robot and applies observation to interleaved joint matrix j
+    // holding one sweep candidate per column, storing the result in r
+    //
+    // Row mask of table holds p(obs|mask) of each candidate, each
+    // candidate is also multiplied by its scale. Per tile sums of each
+    // candidate are stored in the rows of sums
+    void StepSweep(const Matrix<double> &j, Matrix<double> *r, \
+        const Matrix<double> &table, const vector<double> &scale, \
+        Matrix<double> *sums);
+    // Returns the highest probability after observations obs, storing
+    // the states sharing it in results as Localize would
+    //
+    // Starts from the belief of the longest prefix of obs in the cache
+    // and caches beliefs every kCacheInterval steps and at the end
+    double LocalizeCached(const vector<int> &obs, vector<int> *results);
+    // Prints cache hit rate and memory use to stderr prefixed by name
+    void PrintCacheStats(const string &name);
+    // Prints a line with id and the states in top with their probability
+    void PrintTopK(int id, const vector<pair<double, int> > &top);
+    // Prints the most likely states of a belief given as a list of
+    // states and their probabilities, or its top k with --top
+    void PrintEstimate(const vector<pair<int, double> > &estimate);
+    // Reports on stderr how far an approximate belief given as a list of
+    // states and their probabilities is from the grid filter
+    void CompareWithExact(const char *name, \
+        const vector<pair<int, double> > &estimate);
+    // Places every particle on a state drawn uniformly among the states
+    // that are not walls
+    void InitParticles();
+    // Moves every particle along a random open side then weights it by
+    // the likelihood of observation obs
+    //
+    // Returns the sum of the weights
+    double StepParticles(int obs, int step);
+    // Resamples particles systematically so each has equal weight
+    void ResampleParticles(double total, int step);
+    // Stores the normalized weight of each state holding particles in
+    // estimate in index order
+    void EstimateParticles(vector<pair<int, double> > *estimate);
+    // Summarizes the map into the coarse level
+    void InitPyramid();
+    // Moves robot and applies observation obs to coarse belief j storing
+    // the normalized result in r
+    void StepCoarse(int obs, const double *j, double *r);
+    // Applies observation obs to coarse backward message b then moves
+    // it one step back, b is scaled so its largest entry is 1
+    void StepCoarseBackward(int obs, vector<double> *b);
+    // Marks in allowed the blocks whose smoothed mass from forward
+    // belief f and backward message b is worth refining
+    void MarkRefined(const double *f, const vector<double> &b, \
+        unsigned char *allowed);
+    // Places the prior of the states within allowed blocks in m_active
+    void InitRefined(const unsigned char *allowed);
+    // Sparse step keeping only the states within allowed blocks
+    void StepRefined(int obs, const unsigned char *allowed);
+    // Returns coarse block holding state
+    int Block(int state) const;
+    // Moves robot and applies one observation per lane to the
+    // interleaved joint matrix j storing the result in r
+    //
+    // planes holds the observation plane of each lane
+    void StepBatch(const Matrix<double> &j, Matrix<double> *r, \
+        const double *const *planes);
+    // Returns the highest normalized probability of one lane in the
+    // interleaved joint matrix j
+    //
+    // Works as Normalize and FindMostLikely without modifying j
+    double FindMostLikelyLane(const Matrix<double> &j, int lane, \
+        vector<int> *results);
     // Initializes matrix with sensory data
     void InitSensoryMatrix(double error, Matrix<double> *s);
-    // Initializes matrix with transition data
-    void InitTransitionMatrix(Matrix<int> &map, Matrix<double> *t);
-    // Populates matrix with observation data
-    void InitObsMatrix(int obs, Matrix<int> &map, Matrix<double> &s, \
-        Matrix<double> *o);
-
-    // Transposes matrix
-    // m[x][y] becomes m[y][x]
-    void TransposeMatrix(Matrix<double> *m);
-    // Returns resultant matrix
-    //
-    // Multiplies matrices
-    Matrix<double> &MultiplyMatrices(Matrix<double> &m, Matrix<double> &n);
-    // Normalizes matrix by summing all values and dividing each
+    // Initializes the transition stencil
+    //
+    // The transition matrix holds at most four non-zeros per row so
+    // only the move probability of each state and the directions it
+    // can be entered from are stored
+    void InitTransitionStencil(const GridMap &map);
+    // Computes the move probability and inbound and outbound masks of
+    // the state at row and column
+    void UpdateStencil(const GridMap &map, int row, int col);
+    // Applies one transition step to states [begin, end) of joint
+    // matrix j storing the result in r
+    //
+    // Each state pulls probability from its inbound neighbors, O(states)
+    template<typename T>
+    void Predict(const vector<T> &j, vector<T> *r, int begin, int end);
+    // Initializes likelihood table from sensory data
+    //
+    // The table holds p(obs|state) for each of the 16 observations
+    // and 16 states
+    void InitLikelihoodTable(Matrix<double> &s);
+    // Initializes observation planes from the likelihood table, each
+    // plane holds p(obs|state) of every state in the map for one
+    // observation
+    void InitObsPlanes(const GridMap &map);
+    // Applies observation obs then one transition step backwards to
+    // backward matrix b
+    //
+    // b[i] becomes p(i) * sum of plane[n] * b[n] over neighbors n that
+    // state i can move into
+    void StepBackward(int obs, vector<double> *b);
+    // Moves robot and applies observation obs to the log space score
+    // vector d storing the result in r
+    //
+    // The direction of each state's best predecessor is packed into
+    // back when it is not NULL
+    void StepViterbi(int obs, const vector<double> &d, vector<double> *r, \
+        unsigned char *back);
+    // Applies observation to states [begin, end) of joint matrix j
+    //
+    // The observation matrix is diagonal so this is an element-wise
+    // scaling of j by the observation's plane
+    template<typename T>
+    void Observe(int obs, vector<T> *j, int begin, int end);
+    // Normalizes joint matrix by summing all values and dividing each
     // by this value
-    void NormalizeMatrix(Matrix<double> *m);
+    template<typename T>
+    void Normalize(vector<T> *j);
     // Returns the difference between the observation and state
     // e.g.
     // NW (10) = states
@@ -87,12 +616,14 @@ class Robot {
     // This example would return 5
     // Each of the 5 valid states containt atleast 1 valid path e.g. not 
     // equal to 15 which has all four sides blocked
-    int CountValidStates(Matrix<int> &m);
+    int CountValidStates(const GridMap &m);
     // Returns true on success
     // 
     // Parses map contained in file. Format looks as follows
     // 10 12 9
     // 7  15 7
+    //
+    // Binary maps written by --convert are also accepted, see GridMap
     int ParseMap(const char *file);
     // Returns int representation of observation
     // 
@@ -103,109 +634,283 @@ class Robot {
     //
     // NS = 1100 or 12
     int ParseObs(const char *obs);
+    // Returns true on success
+    //
+    // Parses observation sequences, one per line
+    // NW NS E
+    // S SW
+    int ParseSequences(const char *file);
+    // Returns true on success
+    //
+    // Parses observations separated by whitespace or newlines
+    int ParseObsFile(const char *file);
     // Prints programs usage
     void PrintUsage();
     // Prints a matrix
-    void PrintMatrix(Matrix<double> &);
+    void PrintMatrix(const Matrix<double> &);
 };
 
+template<>
+const vector<double> &Robot::Moves<double>() const {
+  return m_move;
+}
+
+template<>
+const vector<float> &Robot::Moves<float>() const {
+  return m_move_f;
+}
+
+template<>
+const Matrix<double> &Robot::Planes<double>() const {
+  return m_planes;
+}
+
+template<>
+const Matrix<float> &Robot::Planes<float>() const {
+  return m_planes_f;
+}
+
+Robot::Robot() : m_closing(false) {
+  m_mode = LOCALIZE;
+  m_profile = NULL;
+  m_error = 0;
+  m_threads = 1;
+  m_memory = 1024;
+  m_prune = 0;
+  m_top = 0;
+  m_sparse = false;
+  m_compare = false;
+  m_particles = 0;
+  m_seed = 1;
+  m_levels = 0;
+  m_refine = 1e-4;
+  m_socket = NULL;
+  m_listener = -1;
+  m_batches = 0;
+  m_bench = NULL;
+  m_bench_cells = 1000000;
+  m_cache_budget = 0;
+  m_cache_reused = 0;
+  m_cache_steps = 0;
+}
+
 // Returns true on success
 int Robot::Init(int argc, char **argv) {
+  int arg(1);
+
   cout << fixed;
   cout << setprecision(6);
 
-  if (argv[1] == NULL) {
+  // Parses options preceding the positional arguments
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; ++arg) {
+    if (strcmp(argv[arg], "--stream") == 0) {
+      m_mode = STREAM;
+    } else if (strcmp(argv[arg], "--batch") == 0 && arg+1 < argc) {
+      m_mode = BATCH;
+
+      if (ParseSequences(argv[++arg]) == 1) {
+        return 1;
+      }
+    } else if (strcmp(argv[arg], "--smooth") == 0) {
+      m_mode = SMOOTH;
+    } else if (strcmp(argv[arg], "--viterbi") == 0) {
+      m_mode = VITERBI;
+    } else if (strcmp(argv[arg], "--convert") == 0 && arg+1 < argc) {
+      m_mode = CONVERT;
+      m_convert = argv[++arg];
+    } else if (strcmp(argv[arg], "--memory") == 0 && arg+1 < argc) {
+      m_memory = atol(argv[++arg]);
+    } else if (strcmp(argv[arg], "--obs") == 0 && arg+1 < argc) {
+      if (ParseObsFile(argv[++arg]) == 1) {
+        return 1;
+      }
+    } else if (strcmp(argv[arg], "--prune") == 0 && arg+1 < argc) {
+      m_prune = atof(argv[++arg]);
+    } else if (strcmp(argv[arg], "--top") == 0 && arg+1 < argc) {
+      m_top = atoi(argv[++arg]);
+    } else if (strcmp(argv[arg], "--particles") == 0 && arg+1 < argc) {
+      m_mode = PARTICLES;
+      m_particles = atoi(argv[++arg]);
+    } else if (strcmp(argv[arg], "--seed") == 0 && arg+1 < argc) {
+      m_seed = strtoull(argv[++arg], NULL, 10);
+    } else if (strcmp(argv[arg], "--pyramid") == 0 && arg+1 < argc) {
+      m_mode = PYRAMID;
+      m_levels = atoi(argv[++arg]);
+    } else if (strcmp(argv[arg], "--refine") == 0 && arg+1 < argc) {
+      m_refine = atof(argv[++arg]);
+    } else if (strcmp(argv[arg], "--server") == 0) {
+      m_mode = SERVER;
+    } else if (strcmp(argv[arg], "--socket") == 0 && arg+1 < argc) {
+      m_socket = argv[++arg];
+    } else if (strcmp(argv[arg], "--profile") == 0 && arg+1 < argc) {
+      m_profile = argv[++arg];
+
+#ifndef ROBOT_PROFILE
+      cerr << "Profiling is disabled, rebuild with make PROFILE=1" << endl;
+
+      return 1;
+#endif
+    } else if (strcmp(argv[arg], "--cache") == 0 && arg+1 < argc) {
+      m_cache_budget = (size_t)atol(argv[++arg]) << 20;
+    } else if (strcmp(argv[arg], "--sweep") == 0 && arg+3 < argc) {
+      double min = atof(argv[++arg]);
+      double max = atof(argv[++arg]);
+      int count = atoi(argv[++arg]);
+
+      m_mode = SWEEP;
+
+      if (count <= 0 || min < 0 || max > 1 || min > max) {
+        cerr << "Sweep needs 0 <= min <= max <= 1 and a positive count"
+             << endl;
+
+        return 1;
+      }
+
+      for (int x = 0; x < count; ++x) {
+        m_sweep_errors.push_back(count == 1 ? min : \
+            min + (max - min) * x / (count - 1));
+      }
+    } else if (strcmp(argv[arg], "--bench") == 0 && arg+1 < argc) {
+      m_mode = BENCH;
+      m_bench = argv[++arg];
+    } else if (strcmp(argv[arg], "--bench-cells") == 0 && arg+1 < argc) {
+      m_bench_cells = atol(argv[++arg]);
+    } else if (strcmp(argv[arg], "--float") == 0) {
+      m_mode = FLOAT;
+    } else if (strcmp(argv[arg], "--compare") == 0) {
+      m_compare = true;
+    } else if (strcmp(argv[arg], "--threads") == 0 && arg+1 < argc) {
+      m_threads = atoi(argv[++arg]);
+    } else {
+      cerr << "Unknown option " << argv[arg] << endl;
+
+      PrintUsage();
+
+      return 1;
+    }
+  }
+
+  if (m_mode == BENCH) {
+    return 0;
+  }
+
+  if (m_mode == SERVER) {
+    for (; arg < argc; ++arg) {
+      const char *split = strchr(argv[arg], '=');
+
+      if (split == NULL) {
+        break;
+      }
+
+      m_map_files.push_back(make_pair(string(argv[arg], split - argv[arg]), \
+          split+1));
+    }
+
+    if (arg < argc || m_map_files.empty()) {
+      PrintUsage();
+
+      return 1;
+    }
+
+    return 0;
+  }
+
+  if (argc - arg < (m_mode == CONVERT || m_mode == SWEEP ? 1 : 2)) {
     PrintUsage(); 
     
     return 1;
   }
 
-  if (ParseMap(argv[1]) == 1) {
+  if (ParseMap(argv[arg]) == 1) {
     return 1;
   } 
 
-  m_error = atof(argv[2]);
+  if (m_mode == CONVERT) {
+    return 0;
+  }
+
+  if (m_mode != SWEEP) {
+    m_error = atof(argv[++arg]);
+  }
 
-  for (int i = 3; i < argc; ++i) {
+  for (int i = arg+1; i < argc; ++i) {
     m_obs.push_back(ParseObs(argv[i]));
   } 
   
   return 0;
 }
 
-int Robot::Localize() {
-  // Variable initializations
-  int states = m_map.size() * m_map[0].size();
-  int valid_states = CountValidStates(m_map);  
-  Matrix(double, j, 1, states);
-  Matrix(double, t, states, states);
-  Matrix(double, s, 1, 5);
-  Matrix(double, o, states, states);
-  
-  // Initialize joint matrix
-  for (int x = 0; x < m_map.size(); ++x) {
-    for (int y = 0; y < m_map[x].size(); ++y) {
-      int index = x*m_map[x].size()+y;
+int Robot::Run() {
+  int result = RunMode();
 
-      // Assigns initial probability to state
-			if (m_map[x][y] == 0xf) {
-        j[index][0] = 0;
-      } else {
-        j[index][0] = (double)1/(double)valid_states;
-      }
-    }
+  if (result == 0 && m_profile != NULL) {
+    return WriteProfile(m_profile);
   }
 
-  InitSensoryMatrix(m_error, &s);
-  InitTransitionMatrix(m_map, &t);
+  return result;
+}
 
-  // Transposes transition matrix  
-  TransposeMatrix(&t);
+int Robot::RunMode() {
+  if (m_mode == STREAM) {
+    return Stream(cin);
+  } else if (m_mode == BATCH) {
+    return Batch();
+  } else if (m_mode == SMOOTH) {
+    return Smooth();
+  } else if (m_mode == VITERBI) {
+    return Viterbi();
+  } else if (m_mode == CONVERT) {
+    return m_map.WriteBinary(m_convert);
+  } else if (m_mode == PARTICLES) {
+    return LocalizeParticles();
+  } else if (m_mode == PYRAMID) {
+    return LocalizePyramid();
+  } else if (m_mode == SERVER) {
+    return Serve();
+  } else if (m_mode == FLOAT) {
+    return LocalizeFloat();
+  } else if (m_mode == SWEEP) {
+    return Sweep();
+  } else if (m_mode == BENCH) {
+    return Bench();
+  }
 
-	j = MultiplyMatrices(t, j);
+  return Localize();
+}
 
-  // Loops through observations
-  for (int x = 0; x < m_obs.size()-1; ++x) {
-    // Populates matrix with observation data
-    InitObsMatrix(m_obs[x], m_map, s, &o);
-    
-    // Multiplies transition by observation matrix
-    Matrix<double> temp = MultiplyMatrices(t, o);
+int Robot::Localize() {
+  InitModel();
 
-    // Adjusts joint matrix base on transition and observation matrix
-    j = MultiplyMatrices(temp, j);
+  // Loops through observations
+  for (int x = 0; x < m_obs.size(); ++x) {
+    Filter(m_obs[x]);
   }
 
-  // Populates matrix with final observation
-  InitObsMatrix(m_obs[m_obs.size()-1], m_map, s, &o);
-  
-  // Adjusts joint matrix
-	j = MultiplyMatrices(o, j);
-
   // Normalizes joint matrix
-  NormalizeMatrix(&j);
+  NormalizeFilter();
 
-  double max(0);
-  vector<int> results;
+  if (m_top > 0) {
+    vector<pair<double, int> > top;
 
-  // Create a vector containing states
-  // with the highest probabilities
-  for (int x = 0; x < j.size(); ++x) {
-    if (j[x][0] > max) {
-      max = j[x][0];
+    FindTopK(m_top, &top);
 
-      results.clear();
+    for (int x = 0; x < top.size(); ++x) {
+      int row = top[x].second / m_map.Width();
+      int col = top[x].second - (row * m_map.Width());
 
-      results.push_back(x);
-    } else if (j[x][0] == max) {
-      results.push_back(x);
+      cout << "(" << row << "," << col << ") " << top[x].first << endl;
     }
+
+    return 0;
   }
 
+  vector<int> results;
+  double max = FindMostLikelyFilter(&results);
+
   // Prints results
   for (int x = 0; x < results.size(); ++x) {
-    int row = results[x] / m_map[0].size();
-    int col = results[x] - (row * m_map[0].size());
+    int row = results[x] / m_map.Width();
+    int col = results[x] - (row * m_map.Width());
 
     cout << "(" << row << "," << col << ") " << max << endl;
   }
@@ -213,182 +918,2943 @@ int Robot::Localize() {
   return 0;
 }
 
-// Initializes sensory matrix using the following equation
-// p(e|s) = error^d * (1-error)^x-d
-// error: sensor error
-// d: Difference between state and observation
-// x: Max differences between state and observation
-void Robot::InitSensoryMatrix(double error, Matrix<double> *s) {
-  for (double x = 0; x < 5; ++x) {
-    (*s)[x][0] = pow(error, x) * pow(1-error, 4-x);
+int Robot::Stream(istream &is) {
+  int step(0);
+  string line;
+  vector<int> results;
+  vector<pair<double, int> > top;
+
+  InitModel();
+
+  while (getline(is, line)) {
+    if (line.empty()) {
+      continue;
+    }
+
+    if (line.compare(0, 5, "edit ") == 0) {
+      int row, col, mask;
+      istringstream edit(line.substr(5));
+
+      if (!(edit >> row >> col >> mask)) {
+        cerr << "Expected edit <row> <col> <mask>" << endl;
+      } else {
+        EditCell(row, col, mask);
+      }
+
+      continue;
+    }
+
+    Filter(ParseObs(line.c_str()));
+
+    // Normalizing every step keeps the joint matrix from underflowing
+    // on long streams
+    NormalizeFilter();
+
+    if (m_top > 0) {
+      FindTopK(m_top, &top);
+
+      PrintTopK(++step, top);
+
+      continue;
+    }
+
+    double max = FindMostLikelyFilter(&results);
+
+    PrintResults(++step, max, results);
   }
+
+  return 0;
 }
 
-// Initializes transition matrix
-void Robot::InitTransitionMatrix(Matrix<int> &m, Matrix<double> *t) {
-  // Determines if states has valid path in each direction
-  for (int x = 0; x < m.size(); ++x) {
-    for (int y = 0; y < m[x].size(); ++y) {
-      int valid_paths = CountValidPaths(m[x][y]);
-      double value = (double)1/(double)valid_paths;
-      int index = x*m[x].size()+y;
-      
-      // Shifts row index one full row backwards
-      if ((m[x][y] & NORTH) == 0x0) {
-        (*t)[index][index-m[x].size()] = value;
-      }
-      
-      // Shifts row index one full row forwards
-      if ((m[x][y] & SOUTH) == 0x0) {
-        (*t)[index][index+m[x].size()] = value;
-      }
- 
-      // Shifts row index one value left
-      if ((m[x][y] & WEST) == 0x0) {
-        (*t)[index][index-1] = value;
+int Robot::Batch() {
+  vector<double> maxes;
+  vector<vector<int> > results;
+
+  // Builds map tables once, m_joint holds the prior afterwards
+  InitModel();
+
+  if (m_cache_budget == 0) {
+    FilterBatch(m_sequences, &maxes, &results);
+  } else {
+    m_cache.reset(new BeliefCache(m_cache_budget));
+
+    maxes.resize(m_sequences.size());
+    results.resize(m_sequences.size());
+
+    for (int x = 0; x < m_sequences.size(); ++x) {
+      maxes[x] = LocalizeCached(m_sequences[x], &results[x]);
+    }
+  }
+
+  for (int x = 0; x < m_sequences.size(); ++x) {
+    PrintResults(x+1, maxes[x], results[x]);
+  }
+
+  if (m_cache) {
+    PrintCacheStats("batch");
+  }
+
+  return 0;
+}
+
+// Localizes sequences
+void Robot::FilterBatch(const vector<vector<int> > &sequences, \
+    vector<double> *maxes, vector<vector<int> > *results) {
+  PROFILE_SCOPE("FilterBatch");
+
+  int states = m_map.States();
+  int count = sequences.size();
+  int groups = (count + kBatchLanes - 1) / kBatchLanes;
+  vector<int> order(count);
+
+  maxes->assign(count, 0);
+  results->assign(count, vector<int>());
+
+  // Groups sequences of similar length so lanes finish together
+  for (int x = 0; x < count; ++x) {
+    order[x] = x;
+  }
+
+  stable_sort(order.begin(), order.end(), [&sequences](int a, int b) {
+    return sequences[a].size() < sequences[b].size();
+  });
+
+  atomic<int> next(0);
+
+  // Each worker takes groups of lanes until none remain, reusing one
+  // pair of interleaved joint matrices, one row per state
+  m_pool->Run(min(m_pool->Size(), groups), [&](int) {
+    int group;
+    Matrix<double> j(states, kBatchLanes);
+    Matrix<double> r(states, kBatchLanes);
+
+    while ((group = next++) < groups) {
+      int lanes = min(kBatchLanes, count - group * kBatchLanes);
+      const int *seq = &order[group * kBatchLanes];
+      int steps = sequences[seq[lanes-1]].size();
+      const double *planes[kBatchLanes];
+
+      j.Resize(states, kBatchLanes);
+
+      for (int x = 0; x < states; ++x) {
+        for (int l = 0; l < lanes; ++l) {
+          j(x, l) = m_joint[x];
+        }
       }
-      
-      // Shifts row index one value right
-      if ((m[x][y] & EAST) == 0x0) {
-        (*t)[index][index+1] = value;
+
+      for (int step = 0; step <= steps; ++step) {
+        for (int l = 0; l < lanes; ++l) {
+          if (sequences[seq[l]].size() != step) {
+            continue;
+          }
+
+          (*maxes)[seq[l]] = FindMostLikelyLane(j, l, &(*results)[seq[l]]);
+
+          // Zeroes finished lanes so they stay out of the way
+          for (int x = 0; x < states; ++x) {
+            j(x, l) = 0;
+          }
+        }
+
+        if (step == steps) {
+          break;
+        }
+
+        for (int l = 0; l < kBatchLanes; ++l) {
+          const vector<int> &obs = sequences[seq[min(l, lanes-1)]];
+
+          planes[l] = m_planes.Row(step < obs.size() ? obs[step] : 0);
+        }
+
+        StepBatch(j, &r, planes);
+        j.Swap(r);
       }
     }
-  } 
+  });
 }
 
-// Initializes observation matrix
-void Robot::InitObsMatrix(\
-    int obs, Matrix<int> &m, Matrix<double> &s, Matrix<double> *o) {
-  for (int x = 0; x < m.size(); ++x) {
-    for (int y = 0; y < m[x].size(); ++y) {
-      int index = x*m[x].size()+y;
-      // Determines difference between state and observation
-			int diff = CalcObsStateDiff(m[x][y], obs);
-     
-     	(*o)[index][index] = s[diff][0]; 
+// Initializes model
+void Robot::InitModel() {
+  InitPrior();
+  InitTables();
+  InitObsPlanes(m_map);
+}
+
+// Initializes prior
+void Robot::InitPrior() {
+  int states = m_map.States();
+  int valid_states = CountValidStates(m_map);  
+
+  m_joint.assign(states, 0);
+  m_predict.assign(states, 0);
+  m_sparse = false;
+
+  // Initialize joint matrix
+  for (int x = 0; x < states; ++x) {
+    // Assigns initial probability to state
+    if (m_map.Cells()[x] != 0xf) {
+      m_joint[x] = (double)1/(double)valid_states;
     }
   }
 }
 
-// Transposes matrix
-void Robot::TransposeMatrix(Matrix<double> *m) {
-  Matrix<double> c(*m);
+// Initializes tables
+void Robot::InitTables() {
+  Matrix<double> s(5, 1);
 
-  for (int x = 0; x < c.size(); ++x) {
-    for (int y = 0; y < c[x].size(); ++y) {
-      (*m)[x][y] = c[y][x];
-    }
+  InitSensoryMatrix(m_error, &s);
+  InitLikelihoodTable(s);
+  InitTransitionStencil(m_map);
+
+  // Splits map into tiles of whole rows
+  m_tile_rows = max(1, kTileStates / m_map.Width());
+  m_tiles = (m_map.Height() + m_tile_rows - 1) / m_tile_rows;
+
+  m_tile_sums.resize(m_tiles);
+  m_tile_counts.resize(m_tiles);
+  m_tile_max.resize(m_tiles);
+  m_tile_results.resize(m_tiles);
+
+  if (!m_pool) {
+    m_pool.reset(new ThreadPool(m_threads));
   }
 }
 
-// Multiplies matrix
-Matrix<double> &Robot::MultiplyMatrices(Matrix<double> &m, Matrix<double> &n) {
-  Matrix<double> *r = PMatrix(double, r, n[0].size(), m.size());
+// Returns range of states in tile
+void Robot::TileBounds(int tile, int *begin, int *end) {
+  int width = m_map.Width();
 
-  for (int x = 0; x < m.size(); ++x) {
-    for (int y = 0; y < n[0].size(); ++y) {
-      double total(0);
-      
-      for (int z = 0; z < n.size(); ++z) {
-        total += m[x][z] * n[z][y];
-      }
-      
-			(*r)[x][y] = total; 
+  *begin = tile * m_tile_rows * width;
+  *end = min((tile+1) * m_tile_rows, m_map.Height()) * width;
+}
+
+// Moves robot and applies observation, the robot moves before
+// each observation
+void Robot::Step(int obs) {
+  StepDense(obs, &m_joint, &m_predict);
+}
+
+template<typename T>
+void Robot::StepDense(int obs, vector<T> *j, vector<T> *r) {
+  m_pool->Run(m_tiles, [&](int tile) {
+    int begin, end, count(0);
+    double sum(0), max(0);
+
+    TileBounds(tile, &begin, &end);
+
+    // Adjusts joint matrix base on transition stencil
+    Predict(*j, r, begin, end);
+
+    // Adjusts joint matrix base on observation
+    Observe(obs, r, begin, end);
+
+    for (int x = begin; x < end; ++x) {
+      sum += (*r)[x];
+      max = (*r)[x] > max ? (*r)[x] : max;
+      count += (*r)[x] != 0;
     }
-  } 
 
-  return *r;
+    m_tile_sums[tile] = sum;
+    m_tile_max[tile] = max;
+    m_tile_counts[tile] = count;
+  });
+
+  j->swap(*r);
 }
 
-// Normalizes matrix
-void Robot::NormalizeMatrix(Matrix<double> *m) {
-  double total(0);
+// Moves robot and applies observation to the filter
+void Robot::Filter(int obs) {
+  PROFILE_SCOPE("Filter");
+
+  int states = m_joint.size();
 
-  for (int x = 0; x < m->size(); ++x) {
-    for (int y = 0; y < (*m)[x].size(); ++y) {
-      total += (*m)[x][y];
+  if (m_sparse) {
+    StepSparse(obs);
+
+    if (m_active.size() * kDenseFraction <= states) {
+      return;
     }
-  }
 
-  for (int x = 0; x < m->size(); ++x) {
-    for (int y = 0; y < (*m)[x].size(); ++y) {
-      (*m)[x][y] /= total;
+    // Probability mass spread out, returns to the joint matrix
+    fill(m_joint.begin(), m_joint.end(), 0);
+
+    for (int x = 0; x < m_active.size(); ++x) {
+      m_joint[m_active[x].first] = m_active[x].second;
     }
+
+    m_sparse = false;
+
+    return;
   }
-}
 
-// Returns difference between state and observation
-int Robot::CalcObsStateDiff(int state, int obs) {
-  int value(0); 
-  int diff = state ^ obs;
+  Step(obs);
 
-  for (int i = 0; i < 4; ++i) {
-    if (((diff >> i) & 0x1) == 0x1) {
-      ++value;
-    } 
+  int count(0);
+  double max(0);
+
+  for (int tile = 0; tile < m_tiles; ++tile) {
+    max = m_tile_max[tile] > max ? m_tile_max[tile] : max;
+    count += m_tile_counts[tile];
   }
 
-  return value;
-}
+  if (m_prune > 0) {
+    double threshold = m_prune * max;
 
-// Returns valid paths of a given state
-int Robot::CountValidPaths(int state) {
-  int value(0);
+    m_pool->Run(m_tiles, [&](int tile) {
+      int begin, end, count(0);
+
+      TileBounds(tile, &begin, &end);
+
+      for (int x = begin; x < end; ++x) {
+        if (m_joint[x] < threshold) {
+          m_joint[x] = 0;
+        }
+
+        count += m_joint[x] != 0;
+      }
+
+      m_tile_counts[tile] = count;
+    });
+
+    count = 0;
+
+    for (int tile = 0; tile < m_tiles; ++tile) {
+      count += m_tile_counts[tile];
+    }
+  }
 
-  for (int x = 0; x < 4; ++x) {
-    if (((state >> x) & 0x1) == 0x0) {
-      ++value;
+  if ((long)count * kSparseFraction > states) {
+    return;
+  }
+
+  // Probability mass is concentrated, switches to the sparse list
+  m_active.clear();
+
+  for (int x = 0; x < states; ++x) {
+    if (m_joint[x] != 0) {
+      m_active.push_back(make_pair(x, m_joint[x]));
     }
   }
 
-  return value; 
+  fill(m_predict.begin(), m_predict.end(), 0);
+
+  m_sparse = true;
 }
 
-// Returns valid states in a map
-int Robot::CountValidStates(Matrix<int> &m) {
-  int value(0);
+// Applies step to sparse list
+void Robot::StepSparse(int obs) {
+  int width = m_map.Width();
+  const double *plane = m_planes.Row(obs);
+  double max(0);
+
+  m_touched.clear();
 
-  for (int x = 0; x < m.size(); ++x) {
-    for (int y = 0; y < m[x].size(); ++y) {
-      if (m[x][y] != 0xf) {
-        ++value;
+  // States are visited in index order so each neighbor sums the same
+  // terms in the same order as Predict
+  for (int x = 0; x < m_active.size(); ++x) {
+    int state = m_active[x].first;
+    int out = m_outbound[state];
+    double value = m_move[state] * m_active[x].second;
+    int next[4] = { state-width, state-1, state+1, state+width };
+    int dirs[4] = { NORTH, WEST, EAST, SOUTH };
+
+    if (value == 0) {
+      continue;
+    }
+
+    for (int d = 0; d < 4; ++d) {
+      if ((out & dirs[d]) == 0x0) {
+        continue;
+      }
+
+      if (m_predict[next[d]] == 0) {
+        m_touched.push_back(next[d]);
       }
+
+      m_predict[next[d]] += value;
     }
   }
 
-  return value;
-}
+  sort(m_touched.begin(), m_touched.end());
 
-int Robot::ParseMap(const char *file) {
-  string line; 
-  ifstream ifs(file);
+  m_active.clear();
 
-  if (ifs.fail()) {
-    cerr << "Failed to open " << file << endl; 
+  // Applies observation clearing the accumulator behind it
+  for (int x = 0; x < m_touched.size(); ++x) {
+    int state = m_touched[x];
+    double value = m_predict[state] * plane[state];
 
-    return 1;
+    m_predict[state] = 0;
+
+    if (value != 0) {
+      m_active.push_back(make_pair(state, value));
+
+      max = value > max ? value : max;
+    }
   }
 
-  while (!ifs.eof()) {
-    getline(ifs, line);
-  
-    if (!line.empty()) {
-      int l(0), r(0);
-      vector<int> row;
+  if (m_prune > 0) {
+    double threshold = m_prune * max;
+    int kept(0);
 
-      while ((r = line.find(' ', l)) != -1) {
-        row.push_back(atoi(line.substr(l, r-l).c_str()));
-        
-        l=r+1;
+    for (int x = 0; x < m_active.size(); ++x) {
+      if (m_active[x].second >= threshold) {
+        m_active[kept++] = m_active[x];
       }
+    }
 
-      row.push_back(atoi(line.substr(l, line.length()-l).c_str()));
-    
-      m_map.push_back(row); 
-    } 
+    m_active.resize(kept);
+  }
+}
+
+// Normalizes belief of filter
+void Robot::NormalizeFilter() {
+  PROFILE_SCOPE("NormalizeFilter");
+
+  if (!m_sparse) {
+    Normalize(&m_joint);
+
+    return;
+  }
+
+  double total(0);
+
+  for (int x = 0; x < m_active.size(); ++x) {
+    total += m_active[x].second;
+  }
+
+  for (int x = 0; x < m_active.size(); ++x) {
+    m_active[x].second /= total;
+  }
+}
+
+// Returns highest probability of filter
+double Robot::FindMostLikelyFilter(vector<int> *results) {
+  PROFILE_SCOPE("FindMostLikely");
+
+  if (!m_sparse) {
+    return FindMostLikely(m_joint, results);
+  }
+
+  double max(0);
+
+  results->clear();
+
+  for (int x = 0; x < m_active.size(); ++x) {
+    if (m_active[x].second > max) {
+      max = m_active[x].second;
+    }
+  }
+
+  for (int x = 0; x < m_active.size(); ++x) {
+    if (m_active[x].second >= max * (1 - kTieTolerance)) {
+      results->push_back(m_active[x].first);
+    }
+  }
+
+  return max;
+}
+
+// Keeps the k largest entries in heap, smallest on top
+//
+// Ties favor the lower state index
+static void PushTopK(int k, double value, int state, \
+    vector<pair<double, int> > *heap) {
+  pair<double, int> entry(value, -state);
+
+  if (heap->size() < k) {
+    heap->push_back(entry);
+    push_heap(heap->begin(), heap->end(), greater<pair<double, int> >());
+  } else if (entry > heap->front()) {
+    pop_heap(heap->begin(), heap->end(), greater<pair<double, int> >());
+    heap->back() = entry;
+    push_heap(heap->begin(), heap->end(), greater<pair<double, int> >());
+  }
+}
+
+// Finds k most probable states of filter
+void Robot::FindTopK(int k, vector<pair<double, int> > *top) {
+  PROFILE_SCOPE("FindTopK");
+
+  top->clear();
+
+  if (m_sparse) {
+    for (int x = 0; x < m_active.size(); ++x) {
+      PushTopK(k, m_active[x].second, m_active[x].first, top);
+    }
+  } else {
+    vector<vector<pair<double, int> > > heaps(m_tiles);
+
+    // Keeps a heap per tile then merges them
+    m_pool->Run(m_tiles, [&](int tile) {
+      int begin, end;
+
+      TileBounds(tile, &begin, &end);
+
+      for (int x = begin; x < end; ++x) {
+        PushTopK(k, m_joint[x], x, &heaps[tile]);
+      }
+    });
+
+    for (int tile = 0; tile < m_tiles; ++tile) {
+      for (int x = 0; x < heaps[tile].size(); ++x) {
+        PushTopK(k, heaps[tile][x].first, -heaps[tile][x].second, top);
+      }
+    }
+  }
+
+  sort_heap(top->begin(), top->end(), greater<pair<double, int> >());
+
+  for (int x = 0; x < top->size(); ++x) {
+    (*top)[x].second = -(*top)[x].second;
+  }
+}
+
+int Robot::Smooth() {
+  PROFILE_SCOPE("Smooth");
+
+  int steps = m_obs.size();
+  int states = m_map.States();
+  int interval = max(1, (int)ceil(sqrt((double)steps)));
+  int checkpoints = (steps + interval - 1) / interval;
+  long recomputed(0);
+  // Forward vectors at every checkpoint and within the current segment
+  Matrix<double> saved(checkpoints, states);
+  Matrix<double> segment(min(interval, steps), states);
+  vector<double> backward(states, 1);
+  vector<double> smoothed(states);
+  vector<double> maxes(steps);
+  vector<vector<int> > results(steps);
+
+  InitModel();
+
+  // Forward pass keeping only checkpoints, saved[k] holds the joint
+  // matrix before step k*interval
+  for (int t = 0; t < steps; ++t) {
+    double total(0);
+
+    if (t % interval == 0) {
+      copy(m_joint.begin(), m_joint.end(), saved.Row(t / interval));
+    }
+
+    Step(m_obs[t]);
+
+    for (int tile = 0; tile < m_tiles; ++tile) {
+      total += m_tile_sums[tile];
+    }
+
+    // Observations no state explains leave nothing to smooth
+    if (total == 0) {
+      cerr << "smooth: no state is consistent with the observations "
+           << "after step " << t+1 << endl;
+
+      return 1;
+    }
+
+    Normalize(&m_joint);
+  }
+
+  // Backward pass over segments from the last to the first
+  for (int k = checkpoints-1; k >= 0; --k) {
+    int begin = k * interval;
+    int end = min(steps, begin + interval);
+
+    // Recomputes forward vectors of the segment from its checkpoint
+    copy(saved.Row(k), saved.Row(k) + states, m_joint.begin());
+
+    for (int t = begin; t < end; ++t) {
+      Step(m_obs[t]);
+      Normalize(&m_joint);
+
+      copy(m_joint.begin(), m_joint.end(), segment.Row(t-begin));
+    }
+
+    recomputed += end - begin;
+
+    for (int t = end-1; t >= begin; --t) {
+      const double *forward = segment.Row(t-begin);
+
+      for (int x = 0; x < states; ++x) {
+        smoothed[x] = forward[x] * backward[x];
+      }
+
+      Normalize(&smoothed);
+
+      maxes[t] = FindMostLikely(smoothed, &results[t]);
+
+      // Backward matrix is scaled every step to avoid underflow, only
+      // its shape matters
+      StepBackward(m_obs[t], &backward);
+      Normalize(&backward);
+    }
+  }
+
+  for (int t = 0; t < steps; ++t) {
+    PrintResults(t+1, maxes[t], results[t]);
+  }
+
+  // Reports memory and recomputation costs
+  long vectors = checkpoints + segment.Rows() + 4;
+
+  cerr << "smooth: steps " << steps << ", checkpoint interval " << interval
+       << ", checkpoints " << checkpoints << endl;
+  cerr << "smooth: stored vectors " << vectors << " ("
+       << vectors * states * sizeof(double) << " bytes), storing every "
+       << "step would take " << (long)(steps + 4) * states * sizeof(double)
+       << " bytes" << endl;
+  cerr << "smooth: forward steps " << steps + recomputed << " ("
+       << recomputed << " recomputed)" << endl;
+
+  return 0;
+}
+
+int Robot::Viterbi() {
+  PROFILE_SCOPE("Viterbi");
+
+  int steps = m_obs.size();
+  int states = m_map.States();
+  int width = m_map.Width();
+  long row_bytes = (states + kBackpointersPerByte - 1) / kBackpointersPerByte;
+  long budget = m_memory << 20;
+  int interval = max(steps, 1);
+  long recomputed(0);
+
+  // Falls back to checkpoints when all backpointers do not fit, the
+  // interval minimizes interval*states/4 + (T/interval)*states*8 bytes
+  if ((long)steps * row_bytes > budget) {
+    interval = min(steps, (int)ceil(sqrt(32.0 * steps)));
+  }
+
+  int segments = (steps + interval - 1) / interval;
+  int last = max(segments-1, 0) * interval;
+  Matrix<double> saved(max(segments-1, 0), states);
+  vector<unsigned char> back(min(interval, steps) * row_bytes);
+  vector<double> delta(states), next(states);
+  vector<int> path(steps+1);
+
+  InitModel();
+
+  m_codes.assign(states, 0);
+
+  // Log space prior
+  for (int x = 0; x < states; ++x) {
+    delta[x] = log(m_joint[x]);
+  }
+
+  // Forward pass keeping checkpoints, backpointers of the last segment
+  // are kept directly as they are traced first
+  for (int t = 0; t < steps; ++t) {
+    if (t % interval == 0 && t < last) {
+      copy(delta.begin(), delta.end(), saved.Row(t / interval));
+    }
+
+    StepViterbi(m_obs[t], delta, &next, \
+        t >= last ? &back[(t-last) * row_bytes] : NULL);
+    delta.swap(next);
+  }
+
+  int state(0);
+  double best = -numeric_limits<double>::infinity();
+
+  for (int x = 0; x < states; ++x) {
+    if (delta[x] > best) {
+      best = delta[x];
+
+      state = x;
+    }
+  }
+
+  // Without a path there are no backpointers to follow
+  if (best == -numeric_limits<double>::infinity()) {
+    cerr << "viterbi: no path is consistent with the observations" << endl;
+
+    return 1;
+  }
+
+  path[steps] = state;
+
+  // Traces back segment by segment from the last
+  for (int k = segments-1; k >= 0; --k) {
+    int begin = k * interval;
+    int end = min(steps, begin + interval);
+
+    if (begin != last) {
+      copy(saved.Row(k), saved.Row(k) + states, delta.begin());
+
+      for (int t = begin; t < end; ++t) {
+        StepViterbi(m_obs[t], delta, &next, &back[(t-begin) * row_bytes]);
+        delta.swap(next);
+      }
+
+      recomputed += end - begin;
+    }
+
+    for (int t = end-1; t >= begin; --t) {
+      int byte = back[(t-begin) * row_bytes + state / kBackpointersPerByte];
+      int code = (byte >> (2 * (state % kBackpointersPerByte))) & 0x3;
+
+      if (code == FROM_NORTH) {
+        state -= width;
+      } else if (code == FROM_SOUTH) {
+        state += width;
+      } else if (code == FROM_WEST) {
+        state -= 1;
+      } else {
+        state += 1;
+      }
+
+      path[t] = state;
+    }
+  }
+
+  for (int t = 0; t <= steps; ++t) {
+    int row = path[t] / width;
+    int col = path[t] - (row * width);
+
+    cout << t << " (" << row << "," << col << ")" << endl;
+  }
+
+  // Reports path probability and memory costs
+  cerr << "viterbi: log probability " << best << endl;
+  cerr << "viterbi: backpointers " << back.size() << " bytes, "
+       << saved.Rows() << " checkpoints " << saved.Size() * sizeof(double)
+       << " bytes" << endl;
+  cerr << "viterbi: forward steps " << steps + recomputed << " ("
+       << recomputed << " recomputed)" << endl;
+
+  return 0;
+}
+
+// Returns seconds elapsed since start
+static double Seconds(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Returns a well mixed 64 bit value of x
+//
+// Particles draw their random numbers by hashing the seed, step and
+// particle index so results do not depend on the thread count
+static uint64_t SplitMix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+  return x ^ (x >> 31);
+}
+
+// Returns uniform random number in [0, 1) for particle index of step
+static double UniformDraw(uint64_t seed, int step, long index) {
+  uint64_t bits = SplitMix64(SplitMix64(seed ^ (uint64_t)step) ^ index);
+
+  return (bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int Robot::LocalizeParticles() {
+  PROFILE_SCOPE("LocalizeParticles");
+
+  int resamples(0);
+  vector<pair<int, double> > estimate;
+
+  if (m_particles <= 0) {
+    cerr << "Particle count must be positive" << endl;
+
+    return 1;
+  }
+
+  InitTables();
+  InitParticles();
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  for (int t = 0; t < m_obs.size(); ++t) {
+    double total = StepParticles(m_obs[t], t);
+
+    // Every particle became impossible, starts over from the prior
+    if (total == 0) {
+      cerr << "particles: all particles lost at step " << t+1 << endl;
+
+      InitParticles();
+
+      continue;
+    }
+
+    double sum_squares(0);
+
+    for (int i = 0; i < m_particles; ++i) {
+      m_particle_weight[i] /= total;
+
+      sum_squares += m_particle_weight[i] * m_particle_weight[i];
+    }
+
+    // Resamples once the effective sample size drops below half
+    if (1 / sum_squares < m_particles / 2.0) {
+      ResampleParticles(1, t);
+
+      ++resamples;
+    }
+  }
+
+  double elapsed = chrono::duration<double, micro>(
+      chrono::steady_clock::now() - start).count();
+
+  EstimateParticles(&estimate);
+  PrintEstimate(estimate);
+
+  cerr << "particles: " << m_particles << " particles, " << m_obs.size()
+       << " steps, " << resamples << " resamples, "
+       << (m_obs.empty() ? 0 : elapsed / m_obs.size()) << " us per step"
+       << endl;
+
+  if (m_compare) {
+    CompareWithExact("particles", estimate);
+  }
+
+  return 0;
+}
+
+// Places particles uniformly
+void Robot::InitParticles() {
+  vector<int> valid;
+  const unsigned char *cells = m_map.Cells();
+
+  for (int x = 0; x < m_map.States(); ++x) {
+    if (cells[x] != 0xf) {
+      valid.push_back(x);
+    }
+  }
+
+  m_particle_state.resize(m_particles);
+  m_particle_weight.assign(m_particles, (double)1/(double)m_particles);
+  m_resampled.resize(m_particles);
+
+  for (int i = 0; i < m_particles; ++i) {
+    m_particle_state[i] = valid[(long)(UniformDraw(m_seed, -1, i) * \
+        valid.size())];
+  }
+}
+
+// Moves and weights particles
+double Robot::StepParticles(int obs, int step) {
+  PROFILE_SCOPE("StepParticles");
+
+  int width = m_map.Width();
+  int chunks = (m_particles + kParticleChunk - 1) / kParticleChunk;
+  const unsigned char *cells = m_map.Cells();
+  const double *likelihood = m_likelihood[obs];
+  double total(0);
+  vector<double> sums(chunks);
+  // Index offset of a move in each direction, 0 without a direction
+  int offset[16] = { 0 };
+
+  offset[NORTH] = -width;
+  offset[SOUTH] = width;
+  offset[WEST] = -1;
+  offset[EAST] = 1;
+
+  // Each chunk goes through separate passes over its arrays with no
+  // branch per particle, an impossible move keeps its state and zeroes
+  // its weight through a factor of 0
+  m_pool->Run(chunks, [&](int chunk) {
+    int begin = chunk * kParticleChunk;
+    int count = min(m_particles, begin + kParticleChunk) - begin;
+    int *state = &m_particle_state[begin];
+    double *weight = &m_particle_weight[begin];
+    double draw[kParticleChunk];
+    double factor[kParticleChunk];
+    double sum(0);
+
+    for (int i = 0; i < count; ++i) {
+      draw[i] = UniformDraw(m_seed, step, begin + i);
+    }
+
+    // States without valid paths have no direction and never move, as
+    // in the grid filter, and moves leading off the map are dropped
+    for (int i = 0; i < count; ++i) {
+      int s = state[i];
+      int mask = cells[s];
+      int dir = kOpenSide[mask][(int)(draw[i] * kOpenSides[mask])];
+      int moves = (m_outbound[s] & dir) != 0x0;
+
+      s += offset[dir & -moves];
+
+      state[i] = s;
+      factor[i] = likelihood[cells[s]] * moves;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      weight[i] *= factor[i];
+    }
+
+    for (int i = 0; i < count; ++i) {
+      sum += weight[i];
+    }
+
+    sums[chunk] = sum;
+  });
+
+  for (int chunk = 0; chunk < chunks; ++chunk) {
+    total += sums[chunk];
+  }
+
+  return total;
+}
+
+// Resamples particles
+void Robot::ResampleParticles(double total, int step) {
+  PROFILE_SCOPE("ResampleParticles");
+
+  int j(0);
+  double spacing = total / m_particles;
+  double position = UniformDraw(m_seed, step, m_particles) * spacing;
+  double cumulative = m_particle_weight[0];
+
+  // One random offset then evenly spaced positions along the
+  // cumulative weights
+  for (int i = 0; i < m_particles; ++i) {
+    while (cumulative < position && j < m_particles-1) {
+      cumulative += m_particle_weight[++j];
+    }
+
+    m_resampled[i] = m_particle_state[j];
+
+    position += spacing;
+  }
+
+  m_particle_state.swap(m_resampled);
+
+  fill(m_particle_weight.begin(), m_particle_weight.end(), spacing);
+}
+
+// Estimates belief from particles
+void Robot::EstimateParticles(vector<pair<int, double> > *estimate) {
+  int kept(0);
+  double total(0);
+
+  estimate->clear();
+
+  for (int i = 0; i < m_particles; ++i) {
+    if (m_particle_weight[i] > 0) {
+      estimate->push_back(make_pair(m_particle_state[i], \
+          m_particle_weight[i]));
+
+      total += m_particle_weight[i];
+    }
+  }
+
+  sort(estimate->begin(), estimate->end());
+
+  // Merges particles sharing a state
+  for (int i = 0; i < estimate->size(); ++i) {
+    if (kept > 0 && (*estimate)[kept-1].first == (*estimate)[i].first) {
+      (*estimate)[kept-1].second += (*estimate)[i].second;
+    } else {
+      (*estimate)[kept++] = (*estimate)[i];
+    }
+  }
+
+  estimate->resize(kept);
+
+  for (int i = 0; i < kept; ++i) {
+    (*estimate)[i].second /= total;
+  }
+}
+
+// Prints estimate
+void Robot::PrintEstimate(const vector<pair<int, double> > &estimate) {
+  double max(0);
+
+  if (m_top > 0) {
+    vector<pair<double, int> > top;
+
+    for (int x = 0; x < estimate.size(); ++x) {
+      PushTopK(m_top, estimate[x].second, estimate[x].first, &top);
+    }
+
+    sort_heap(top.begin(), top.end(), greater<pair<double, int> >());
+
+    for (int x = 0; x < top.size(); ++x) {
+      int row = -top[x].second / m_map.Width();
+      int col = -top[x].second - (row * m_map.Width());
+
+      cout << "(" << row << "," << col << ") " << top[x].first << endl;
+    }
+
+    return;
+  }
+
+  for (int x = 0; x < estimate.size(); ++x) {
+    if (estimate[x].second > max) {
+      max = estimate[x].second;
+    }
+  }
+
+  // Prints results
+  for (int x = 0; x < estimate.size(); ++x) {
+    if (estimate[x].second >= max * (1 - kTieTolerance)) {
+      int row = estimate[x].first / m_map.Width();
+      int col = estimate[x].first - (row * m_map.Width());
+
+      cout << "(" << row << "," << col << ") " << max << endl;
+    }
+  }
+}
+
+// Compares estimate with grid filter
+void Robot::CompareWithExact(const char *name, \
+    const vector<pair<int, double> > &estimate) {
+  int best(0), exact_best(0);
+  double distance(0);
+  vector<double> exact;
+
+  // Runs the grid filter over the same observations, normalizing
+  // every step keeps it from underflowing on long sequences
+  InitModel();
+
+  for (int x = 0; x < m_obs.size(); ++x) {
+    Filter(m_obs[x]);
+    NormalizeFilter();
+  }
+
+  exact.assign(m_map.States(), 0);
+
+  if (m_sparse) {
+    for (int x = 0; x < m_active.size(); ++x) {
+      exact[m_active[x].first] = m_active[x].second;
+    }
+  } else {
+    exact.swap(m_joint);
+  }
+
+  for (int x = 0; x < exact.size(); ++x) {
+    distance += exact[x];
+
+    if (exact[x] > exact[exact_best]) {
+      exact_best = x;
+    }
+  }
+
+  // L1 distance, states missing from the estimate count fully
+  for (int x = 0; x < estimate.size(); ++x) {
+    double p = exact[estimate[x].first];
+
+    distance += fabs(estimate[x].second - p) - p;
+
+    if (estimate[x].second > estimate[best].second) {
+      best = x;
+    }
+  }
+
+  int state = estimate.empty() ? 0 : estimate[best].first;
+
+  cerr << name << ": L1 distance to grid filter " << distance << endl;
+  cerr << name << ": grid filter most likely ("
+       << exact_best / m_map.Width() << "," << exact_best % m_map.Width()
+       << ") " << exact[exact_best] << ", estimated most likely ("
+       << state / m_map.Width() << "," << state % m_map.Width()
+       << ") with grid filter probability " << exact[state] << endl;
+}
+
+int Robot::LocalizePyramid() {
+  PROFILE_SCOPE("LocalizePyramid");
+
+  int steps = m_obs.size();
+  int coarse;
+  long refined(0);
+  Matrix<double> forward;
+  Matrix<unsigned char> allowed;
+  vector<double> backward;
+
+  if (m_levels <= 0 || m_levels > 15) {
+    cerr << "Pyramid levels must be between 1 and 15" << endl;
+
+    return 1;
+  }
+
+  InitTables();
+  InitPyramid();
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  coarse = m_coarse_prior.size();
+
+  forward.Resize(steps+1, coarse, 0);
+  allowed.Resize(steps+1, coarse, 0);
+  backward.assign(coarse, 1);
+
+  copy(m_coarse_prior.begin(), m_coarse_prior.end(), forward.Row(0));
+
+  // Filters the coarse level keeping every belief
+  for (int t = 0; t < steps; ++t) {
+    StepCoarse(m_obs[t], forward.Row(t), forward.Row(t+1));
+  }
+
+  // Smooths the coarse level backwards marking the blocks to refine
+  for (int t = steps; t >= 0; --t) {
+    if (t < steps) {
+      StepCoarseBackward(m_obs[t], &backward);
+    }
+
+    MarkRefined(forward.Row(t), backward, allowed.Row(t));
+  }
+
+  InitRefined(allowed.Row(0));
+
+  // Filters the full resolution map within the marked blocks
+  for (int t = 0; t < steps; ++t) {
+    StepRefined(m_obs[t], allowed.Row(t+1));
+
+    refined += m_active.size();
+  }
+
+  double elapsed = chrono::duration<double, micro>(
+      chrono::steady_clock::now() - start).count();
+  double total(0);
+
+  for (int x = 0; x < m_active.size(); ++x) {
+    total += m_active[x].second;
+  }
+
+  // The marked blocks can miss every state consistent with the
+  // observations, leaving nothing to report
+  if (total == 0) {
+    cerr << "pyramid: no refined state explains the observations, "
+         << "lower --refine" << endl;
+
+    return 1;
+  }
+
+  for (int x = 0; x < m_active.size(); ++x) {
+    m_active[x].second /= total;
+  }
+
+  PrintEstimate(m_active);
+
+  cerr << "pyramid: " << (1 << m_levels) << "x" << (1 << m_levels)
+       << " blocks, " << coarse << " coarse states, "
+       << (steps == 0 ? 0 : refined / steps) << " refined states per step, "
+       << (steps == 0 ? 0 : elapsed / steps) << " us per step" << endl;
+
+  if (m_compare) {
+    vector<pair<int, double> > estimate(m_active);
+
+    CompareWithExact("pyramid", estimate);
+  }
+
+  return 0;
+}
+
+// Initializes coarse level
+void Robot::InitPyramid() {
+  int width = m_map.Width();
+  int states = m_map.States();
+  int valid_states = CountValidStates(m_map);
+  const unsigned char *cells = m_map.Cells();
+  int side = 1 << m_levels;
+  int coarse;
+  vector<int> counts;
+  Matrix<int> histogram;
+
+  m_coarse_width = (width + side-1) >> m_levels;
+  m_coarse_height = (m_map.Height() + side-1) >> m_levels;
+
+  coarse = m_coarse_width * m_coarse_height;
+
+  counts.assign(coarse, 0);
+  histogram.Resize(coarse, 16, 0);
+
+  m_coarse_prior.assign(coarse, 0);
+  m_coarse_stay.assign(coarse, 0);
+  m_coarse_cross.Resize(coarse, 4, 0);
+  m_coarse_planes.Resize(16, coarse, 0);
+
+  // Sums masks and moves of the cells within each block
+  for (int x = 0; x < states; ++x) {
+    int block = Block(x);
+    int out = m_outbound[x];
+    int next[4] = { x-width, x-1, x+1, x+width };
+    int dirs[4] = { NORTH, WEST, EAST, SOUTH };
+
+    if (cells[x] == 0xf) {
+      continue;
+    }
+
+    ++counts[block];
+    ++histogram(block, cells[x]);
+
+    for (int d = 0; d < 4; ++d) {
+      if ((out & dirs[d]) == 0x0) {
+        continue;
+      }
+
+      if (Block(next[d]) == block) {
+        m_coarse_stay[block] += m_move[x];
+      } else {
+        m_coarse_cross(block, d) += m_move[x];
+      }
+    }
+  }
+
+  // Averages over the cells of each block assuming the belief is
+  // spread evenly within it
+  for (int block = 0; block < coarse; ++block) {
+    if (counts[block] == 0) {
+      continue;
+    }
+
+    m_coarse_prior[block] = (double)counts[block]/(double)valid_states;
+    m_coarse_stay[block] /= counts[block];
+
+    for (int d = 0; d < 4; ++d) {
+      m_coarse_cross(block, d) /= counts[block];
+    }
+
+    for (int obs = 0; obs < 16; ++obs) {
+      double total(0);
+
+      for (int mask = 0; mask < 16; ++mask) {
+        total += histogram(block, mask) * m_likelihood[obs][mask];
+      }
+
+      m_coarse_planes(obs, block) = total / counts[block];
+    }
+  }
+}
+
+// Moves robot and applies observation on coarse level
+void Robot::StepCoarse(int obs, const double *j, double *r) {
+  PROFILE_SCOPE("StepCoarse");
+
+  int width = m_coarse_width;
+  int coarse = m_coarse_prior.size();
+  const double *plane = m_coarse_planes.Row(obs);
+  double sum(0);
+
+  for (int x = 0; x < coarse; ++x) {
+    int col = x % width;
+    double total = m_coarse_stay[x] * j[x];
+
+    // Neighbors are summed in index order
+    if (x >= width) {
+      total += m_coarse_cross(x-width, 3) * j[x-width];
+    }
+
+    if (col > 0) {
+      total += m_coarse_cross(x-1, 2) * j[x-1];
+    }
+
+    if (col < width-1) {
+      total += m_coarse_cross(x+1, 1) * j[x+1];
+    }
+
+    if (x + width < coarse) {
+      total += m_coarse_cross(x+width, 0) * j[x+width];
+    }
+
+    r[x] = total * plane[x];
+    sum += r[x];
+  }
+
+  if (sum == 0) {
+    return;
+  }
+
+  for (int x = 0; x < coarse; ++x) {
+    r[x] /= sum;
+  }
+}
+
+// Applies observation then moves robot backwards on coarse level
+void Robot::StepCoarseBackward(int obs, vector<double> *b) {
+  PROFILE_SCOPE("StepCoarseBackward");
+
+  int width = m_coarse_width;
+  int coarse = b->size();
+  const double *plane = m_coarse_planes.Row(obs);
+  double max(0);
+  vector<double> weighted(coarse);
+
+  for (int x = 0; x < coarse; ++x) {
+    weighted[x] = (*b)[x] * plane[x];
+  }
+
+  for (int x = 0; x < coarse; ++x) {
+    int col = x % width;
+    double total = m_coarse_stay[x] * weighted[x];
+
+    if (x >= width) {
+      total += m_coarse_cross(x, 0) * weighted[x-width];
+    }
+
+    if (col > 0) {
+      total += m_coarse_cross(x, 1) * weighted[x-1];
+    }
+
+    if (col < width-1) {
+      total += m_coarse_cross(x, 2) * weighted[x+1];
+    }
+
+    if (x + width < coarse) {
+      total += m_coarse_cross(x, 3) * weighted[x+width];
+    }
+
+    (*b)[x] = total;
+
+    max = total > max ? total : max;
+  }
+
+  if (max == 0) {
+    return;
+  }
+
+  for (int x = 0; x < coarse; ++x) {
+    (*b)[x] /= max;
+  }
+}
+
+// Marks blocks to refine
+void Robot::MarkRefined(const double *f, const vector<double> &b, \
+    unsigned char *allowed) {
+  int width = m_coarse_width;
+  int coarse = b.size();
+  double max(0);
+
+  for (int x = 0; x < coarse; ++x) {
+    max = f[x] * b[x] > max ? f[x] * b[x] : max;
+  }
+
+  if (max == 0) {
+    return;
+  }
+
+  // Neighbors are marked too since the robot may cross into them
+  for (int x = 0; x < coarse; ++x) {
+    int col = x % width;
+
+    if (f[x] * b[x] < m_refine * max) {
+      continue;
+    }
+
+    allowed[x] = 1;
+
+    if (x >= width) {
+      allowed[x-width] = 1;
+    }
+
+    if (col > 0) {
+      allowed[x-1] = 1;
+    }
+
+    if (col < width-1) {
+      allowed[x+1] = 1;
+    }
+
+    if (x + width < coarse) {
+      allowed[x+width] = 1;
+    }
+  }
+}
+
+// Initializes refined belief
+void Robot::InitRefined(const unsigned char *allowed) {
+  int states = m_map.States();
+  int valid_states = CountValidStates(m_map);
+  const unsigned char *cells = m_map.Cells();
+
+  m_active.clear();
+  m_predict.assign(states, 0);
+
+  for (int x = 0; x < states; ++x) {
+    if (cells[x] != 0xf && allowed[Block(x)]) {
+      m_active.push_back(make_pair(x, (double)1/(double)valid_states));
+    }
+  }
+}
+
+// Moves robot and applies observation within marked blocks
+void Robot::StepRefined(int obs, const unsigned char *allowed) {
+  PROFILE_SCOPE("StepRefined");
+
+  int width = m_map.Width();
+  const unsigned char *cells = m_map.Cells();
+  const double *likelihood = m_likelihood[obs];
+
+  m_touched.clear();
+
+  for (int x = 0; x < m_active.size(); ++x) {
+    int state = m_active[x].first;
+    int out = m_outbound[state];
+    double value = m_move[state] * m_active[x].second;
+    int next[4] = { state-width, state-1, state+1, state+width };
+    int dirs[4] = { NORTH, WEST, EAST, SOUTH };
+
+    if (value == 0) {
+      continue;
+    }
+
+    for (int d = 0; d < 4; ++d) {
+      if ((out & dirs[d]) == 0x0 || !allowed[Block(next[d])]) {
+        continue;
+      }
+
+      if (m_predict[next[d]] == 0) {
+        m_touched.push_back(next[d]);
+      }
+
+      m_predict[next[d]] += value;
+    }
+  }
+
+  sort(m_touched.begin(), m_touched.end());
+
+  m_active.clear();
+
+  double sum(0);
+
+  // Applies observation clearing the accumulator behind it
+  for (int x = 0; x < m_touched.size(); ++x) {
+    int state = m_touched[x];
+    double value = m_predict[state] * likelihood[cells[state]];
+
+    m_predict[state] = 0;
+
+    if (value != 0) {
+      m_active.push_back(make_pair(state, value));
+      sum += value;
+    }
+  }
+
+  // Normalizes like the coarse level so long sequences do not underflow
+  for (int x = 0; x < m_active.size(); ++x) {
+    m_active[x].second /= sum;
+  }
+}
+
+// Returns coarse block of state
+int Robot::Block(int state) const {
+  int row = state / m_map.Width();
+  int col = state - (row * m_map.Width());
+
+  return (row >> m_levels) * m_coarse_width + (col >> m_levels);
+}
+
+int Robot::Serve() {
+  int listener(-1);
+  thread reader;
+  vector<thread> readers;
+
+  // Preloads every map with its transition stencil
+  for (int x = 0; x < m_map_files.size(); ++x) {
+    unique_ptr<Robot> robot(new Robot());
+
+    if (robot->ParseMap(m_map_files[x].second) == 1) {
+      return 1;
+    }
+
+    robot->InitModel();
+
+    if (m_cache_budget > 0) {
+      robot->m_cache_budget = m_cache_budget;
+      robot->m_cache.reset(new BeliefCache(m_cache_budget));
+    }
+
+    m_servers[m_map_files[x].first] = move(robot);
+  }
+
+  if (!m_pool) {
+    m_pool.reset(new ThreadPool(m_threads));
+  }
+
+  if (m_socket == NULL) {
+    m_connections.push_back(unique_ptr<Connection>(new Connection(0, 1)));
+
+    reader = thread(&Robot::ReadRequests, this, m_connections[0].get());
+  } else {
+    sockaddr_un address;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, m_socket, sizeof(address.sun_path) - 1);
+
+    unlink(m_socket);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listener < 0 || \
+        bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || \
+        listen(listener, 64) != 0) {
+      cerr << "Failed to listen on " << m_socket << endl;
+
+      return 1;
+    }
+
+    m_listener = listener;
+
+    // Accepts connections until shutdown, each read by a thread of its
+    // own
+    reader = thread([this, listener, &readers]() {
+      int fd;
+
+      while ((fd = accept(listener, NULL, NULL)) >= 0) {
+        lock_guard<mutex> lock(m_queue_mutex);
+
+        if (m_closing) {
+          close(fd);
+
+          break;
+        }
+
+        m_connections.push_back(unique_ptr<Connection>( \
+            new Connection(fd, fd)));
+
+        readers.push_back(thread(&Robot::ReadRequests, this, \
+            m_connections.back().get()));
+      }
+    });
+  }
+
+  cerr << "server: " << m_servers.size() << " maps loaded, "
+       << m_pool->Size() << " workers" << endl;
+
+  m_pool->Run(m_pool->Size(), [this](int) {
+    AnswerRequests();
+  });
+
+  reader.join();
+
+  // Unblocks connections still waiting for requests
+  {
+    lock_guard<mutex> lock(m_queue_mutex);
+
+    for (int x = 0; x < m_connections.size(); ++x) {
+      if (m_connections[x]->in > 0) {
+        shutdown(m_connections[x]->in, SHUT_RD);
+      }
+    }
+  }
+
+  for (int x = 0; x < readers.size(); ++x) {
+    readers[x].join();
+  }
+
+  if (listener >= 0) {
+    close(listener);
+    unlink(m_socket);
+  }
+
+  PrintLatencies();
+
+  for (map<string, unique_ptr<Robot> >::iterator it = m_servers.begin(); \
+      it != m_servers.end(); ++it) {
+    if (it->second->m_cache) {
+      it->second->PrintCacheStats("server: " + it->first);
+    }
+  }
+
+  return 0;
+}
+
+// Reads requests
+void Robot::ReadRequests(Connection *conn) {
+  char buffer[4096];
+  string pending;
+  ssize_t count;
+
+  // Sockets are read until Serve shuts them down so every request gets
+  // an answer, stdin stops at shutdown
+  while ((m_socket != NULL || !m_closing) && \
+      (count = read(conn->in, buffer, sizeof(buffer))) > 0) {
+    pending.append(buffer, count);
+
+    size_t begin(0), end;
+
+    while ((end = pending.find('\n', begin)) != string::npos) {
+      QueueRequest(conn, pending.substr(begin, end - begin));
+
+      begin = end + 1;
+    }
+
+    pending.erase(0, begin);
+  }
+
+  if (!pending.empty()) {
+    QueueRequest(conn, pending);
+  }
+
+  // Stdin reaching its end shuts the server down
+  if (m_socket == NULL) {
+    Shutdown();
+  }
+
+  lock_guard<mutex> lock(m_queue_mutex);
+
+  conn->reading = false;
+
+  FinishConnection(conn);
+}
+
+// Parses and queues request
+void Robot::QueueRequest(Connection *conn, const string &line) {
+  Request request;
+  string name, obs;
+  istringstream is(line);
+
+  if (!(is >> request.id)) {
+    return;
+  }
+
+  if (request.id == "shutdown") {
+    Shutdown();
+
+    return;
+  }
+
+  if (!(is >> name)) {
+    WriteLine(conn, request.id + " error expected <id> <map> <error> <obs>...");
+
+    return;
+  }
+
+  request.edit = name == "edit";
+  request.error = 0;
+
+  if (request.edit) {
+    int row, col, mask;
+
+    if (!(is >> name >> row >> col >> mask)) {
+      WriteLine(conn, request.id + \
+          " error expected <id> edit <map> <row> <col> <mask>");
+
+      return;
+    }
+
+    request.obs.push_back(row);
+    request.obs.push_back(col);
+    request.obs.push_back(mask);
+  } else if (!(is >> request.error)) {
+    WriteLine(conn, request.id + " error expected <id> <map> <error> <obs>...");
+
+    return;
+  }
+
+  map<string, unique_ptr<Robot> >::iterator it = m_servers.find(name);
+
+  if (it == m_servers.end()) {
+    WriteLine(conn, request.id + " error unknown map " + name);
+
+    return;
+  }
+
+  while (!request.edit && is >> obs) {
+    request.obs.push_back(ParseObs(obs.c_str()));
+  }
+
+  request.robot = it->second.get();
+  request.conn = conn;
+  request.arrival = chrono::steady_clock::now();
+
+  {
+    lock_guard<mutex> lock(m_queue_mutex);
+
+    if (!m_closing) {
+      ++conn->pending;
+
+      m_queue.push_back(request);
+      m_queue_ready.notify_one();
+
+      return;
+    }
+  }
+
+  // Requests arriving once shutdown started are refused rather than
+  // left unanswered
+  WriteLine(conn, request.id + " error shutting down");
+}
+
+// Answers requests
+void Robot::AnswerRequests() {
+  vector<Request> batch;
+  vector<vector<int> > sequences;
+  vector<double> maxes;
+  vector<vector<int> > results;
+
+  while (true) {
+    Robot *robot(NULL);
+
+    batch.clear();
+
+    {
+      unique_lock<mutex> lock(m_queue_mutex);
+
+      // Takes the oldest request whose map is free along with every
+      // queued request sharing its map and error
+      while (robot == NULL) {
+        for (int x = 0; x < m_queue.size() && robot == NULL; ++x) {
+          if (m_busy.count(m_queue[x].robot) == 0) {
+            robot = m_queue[x].robot;
+          }
+        }
+
+        if (robot != NULL) {
+          break;
+        }
+
+        if (m_closing && m_queue.empty()) {
+          return;
+        }
+
+        m_queue_ready.wait(lock);
+      }
+
+      double error(-1);
+
+      // Edits are answered alone and requests queued after an edit
+      // wait for it
+      for (deque<Request>::iterator it = m_queue.begin(); \
+          it != m_queue.end() && batch.size() < kServerBatch;) {
+        if (it->robot == robot && it->edit) {
+          if (batch.empty()) {
+            batch.push_back(*it);
+            m_queue.erase(it);
+          }
+
+          break;
+        }
+
+        if (it->robot == robot && (batch.empty() || it->error == error)) {
+          error = it->error;
+
+          batch.push_back(*it);
+          it = m_queue.erase(it);
+        } else {
+          ++it;
+        }
+      }
+
+      m_busy.insert(robot);
+      ++m_batches;
+    }
+
+    sequences.clear();
+
+    for (int x = 0; x < batch.size(); ++x) {
+      sequences.push_back(batch[x].obs);
+    }
+
+    if (batch[0].edit) {
+      const vector<int> &edit = batch[0].obs;
+
+      WriteLine(batch[0].conn, batch[0].id + \
+          (robot->EditCell(edit[0], edit[1], edit[2]) == 0 ? \
+              " ok" : " error invalid edit"));
+    } else {
+      robot->SetError(batch[0].error);
+
+      if (robot->m_cache) {
+        maxes.resize(batch.size());
+        results.resize(batch.size());
+
+        for (int x = 0; x < batch.size(); ++x) {
+          maxes[x] = robot->LocalizeCached(sequences[x], &results[x]);
+        }
+      } else {
+        robot->FilterBatch(sequences, &maxes, &results);
+      }
+
+      for (int x = 0; x < batch.size(); ++x) {
+        ostringstream os;
+
+        os << fixed << setprecision(6);
+
+        robot->PrintResults(os, batch[x].id, maxes[x], results[x]);
+
+        WriteLine(batch[x].conn, os.str());
+      }
+    }
+
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    lock_guard<mutex> lock(m_queue_mutex);
+
+    for (int x = 0; x < batch.size(); ++x) {
+      m_latencies.push_back(chrono::duration<double, micro>( \
+          now - batch[x].arrival).count());
+    }
+
+    m_busy.erase(robot);
+    m_queue_ready.notify_all();
+
+    for (int x = 0; x < batch.size(); ++x) {
+      --batch[x].conn->pending;
+
+      FinishConnection(batch[x].conn);
+    }
+  }
+}
+
+// Writes line to connection
+void Robot::WriteLine(Connection *conn, const string &line) {
+  string data = line + "\n";
+  size_t written(0);
+  lock_guard<mutex> lock(conn->lock);
+
+  while (written < data.size()) {
+    ssize_t count = write(conn->out, data.data() + written, \
+        data.size() - written);
+
+    // Clients that went away lose their answers
+    if (count <= 0) {
+      return;
+    }
+
+    written += count;
+  }
+}
+
+// Closes connection once finished
+void Robot::FinishConnection(Connection *conn) {
+  if (conn->reading || conn->pending > 0 || conn->in <= 0) {
+    return;
+  }
+
+  close(conn->in);
+
+  conn->in = -1;
+}
+
+// Shuts server down
+void Robot::Shutdown() {
+  lock_guard<mutex> lock(m_queue_mutex);
+
+  m_closing = true;
+  m_queue_ready.notify_all();
+
+  if (m_listener >= 0) {
+    shutdown(m_listener, SHUT_RDWR);
+  }
+}
+
+// Prints latency percentiles
+void Robot::PrintLatencies() {
+  int count = m_latencies.size();
+  double quantiles[4] = { 0.5, 0.9, 0.99, 1 };
+  const char *names[4] = { "p50", "p90", "p99", "max" };
+
+  sort(m_latencies.begin(), m_latencies.end());
+
+  cerr << "server: " << count << " requests in " << m_batches
+       << " batches";
+
+  // Nearest rank percentiles
+  for (int x = 0; x < 4 && count > 0; ++x) {
+    int rank = (int)ceil(quantiles[x] * count);
+
+    cerr << ", " << names[x] << " " << m_latencies[max(rank, 1) - 1]
+         << " us";
+  }
+
+  cerr << endl;
+}
+
+// Sets sensor error
+void Robot::SetError(double error) {
+  Matrix<double> s(5, 1);
+
+  if (error == m_error) {
+    return;
+  }
+
+  m_error = error;
+
+  InitSensoryMatrix(m_error, &s);
+  InitLikelihoodTable(s);
+  InitObsPlanes(m_map);
+}
+
+int Robot::LocalizeFloat() {
+  PROFILE_SCOPE("LocalizeFloat");
+
+  int renormalized(0);
+
+  InitTables();
+  InitFloatModel();
+
+  // Loops through observations
+  for (int x = 0; x < m_obs.size(); ++x) {
+    PROFILE_SCOPE("StepFloat");
+
+    double total(0);
+
+    StepDense(m_obs[x], &m_joint_f, &m_predict_f);
+
+    for (int tile = 0; tile < m_tiles; ++tile) {
+      total += m_tile_sums[tile];
+    }
+
+    if (total > 0 && total < kFloatRenormalize) {
+      Normalize(&m_joint_f);
+
+      ++renormalized;
+    }
+  }
+
+  Normalize(&m_joint_f);
+
+  vector<pair<int, double> > estimate;
+
+  if (m_top > 0 || m_compare) {
+    for (int x = 0; x < m_joint_f.size(); ++x) {
+      if (m_joint_f[x] != 0) {
+        estimate.push_back(make_pair(x, (double)m_joint_f[x]));
+      }
+    }
+  }
+
+  if (m_top > 0) {
+    PrintEstimate(estimate);
+  } else {
+    vector<int> results;
+    double max = FindMostLikely(m_joint_f, &results);
+
+    // Prints results
+    for (int x = 0; x < results.size(); ++x) {
+      int row = results[x] / m_map.Width();
+      int col = results[x] - (row * m_map.Width());
+
+      cout << "(" << row << "," << col << ") " << max << endl;
+    }
+  }
+
+  if (m_compare) {
+    cerr << "float: renormalized " << renormalized << " times" << endl;
+
+    m_joint_f.clear();
+    m_predict_f.clear();
+    m_planes_f.Resize(0, 0);
+
+    CompareWithExact("float", estimate);
+  }
+
+  return 0;
+}
+
+// Initializes float model
+void Robot::InitFloatModel() {
+  int states = m_map.States();
+  int valid_states = CountValidStates(m_map);
+  const unsigned char *cells = m_map.Cells();
+
+  m_joint_f.assign(states, 0);
+  m_predict_f.assign(states, 0);
+  m_move_f.assign(m_move.begin(), m_move.end());
+  m_planes_f.Resize(16, states);
+
+  for (int x = 0; x < states; ++x) {
+    if (cells[x] != 0xf) {
+      m_joint_f[x] = (float)1/(float)valid_states;
+    }
+  }
+
+  for (int obs = 0; obs < 16; ++obs) {
+    float *plane = m_planes_f.Row(obs);
+
+    for (int x = 0; x < states; ++x) {
+      plane[x] = m_likelihood[obs][cells[x]];
+    }
+  }
+}
+
+double Robot::LocalizeCached(const vector<int> &obs, vector<int> *results) {
+  PROFILE_SCOPE("LocalizeCached");
+
+  const CachedBelief *belief;
+  int depth = m_cache->Find(m_error, obs.data(), obs.size(), &belief);
+
+  // Resumes from the longest cached prefix
+  if (depth > 0) {
+    m_sparse = belief->sparse;
+
+    if (m_sparse) {
+      m_active = belief->active;
+
+      fill(m_predict.begin(), m_predict.end(), 0);
+    } else {
+      m_joint = belief->joint;
+    }
+  } else {
+    InitPrior();
+  }
+
+  m_cache_reused += depth;
+  m_cache_steps += obs.size();
+
+  for (int x = depth; x < obs.size(); ++x) {
+    Filter(obs[x]);
+
+    if ((x+1) % kCacheInterval != 0 && x+1 != obs.size()) {
+      continue;
+    }
+
+    CachedBelief snapshot;
+
+    snapshot.sparse = m_sparse;
+
+    if (m_sparse) {
+      snapshot.active = m_active;
+    } else {
+      snapshot.joint = m_joint;
+    }
+
+    m_cache->Insert(m_error, obs.data(), x+1, &snapshot);
+  }
+
+  NormalizeFilter();
+
+  return FindMostLikelyFilter(results);
+}
+
+// Prints cache statistics
+void Robot::PrintCacheStats(const string &name) {
+  long lookups = m_cache->Lookups();
+
+  cerr << name << ": cache " << m_cache->Hits() << " hits in " << lookups
+       << " lookups (" << (lookups == 0 ? 0 : 100.0 * m_cache->Hits() / \
+          lookups) << "%), " << m_cache_reused << " of " << m_cache_steps
+       << " steps reused, " << m_cache->Beliefs() << " beliefs in "
+       << m_cache->Bytes() << " bytes, " << m_cache->Evictions()
+       << " evictions" << endl;
+}
+
+int Robot::Sweep() {
+  PROFILE_SCOPE("Sweep");
+
+  int states = m_map.States();
+  int count = m_sweep_errors.size();
+  int best(0);
+  vector<double> likelihood(count * 256);
+  vector<double> scale(count, 1);
+  vector<double> log_likelihood(count, 0);
+  Matrix<double> j(states, count);
+  Matrix<double> r(states, count);
+  Matrix<double> table(16, count);
+  Matrix<double> sums;
+
+  m_error = m_sweep_errors[0];
+
+  InitPrior();
+  InitTables();
+
+  sums.Resize(m_tiles, count);
+
+  // p(obs|state) of every candidate indexed by [lane][obs][state]
+  for (int l = 0; l < count; ++l) {
+    Matrix<double> s(5, 1);
+
+    InitSensoryMatrix(m_sweep_errors[l], &s);
+
+    for (int obs = 0; obs < 16; ++obs) {
+      for (int mask = 0; mask < 16; ++mask) {
+        likelihood[l*256 + obs*16 + mask] = \
+            s(CalcObsStateDiff(mask, obs), 0);
+      }
+    }
+  }
+
+  for (int x = 0; x < states; ++x) {
+    for (int l = 0; l < count; ++l) {
+      j(x, l) = m_joint[x];
+    }
+  }
+
+  for (int t = 0; t < m_obs.size(); ++t) {
+    for (int mask = 0; mask < 16; ++mask) {
+      for (int l = 0; l < count; ++l) {
+        table(mask, l) = likelihood[l*256 + m_obs[t]*16 + mask];
+      }
+    }
+
+    StepSweep(j, &r, table, scale, &sums);
+    j.Swap(r);
+
+    // The sum of each lane is p(obs|previous observations) since the
+    // previous belief was scaled to one
+    for (int l = 0; l < count; ++l) {
+      double total(0);
+
+      for (int tile = 0; tile < m_tiles; ++tile) {
+        total += sums(tile, l);
+      }
+
+      log_likelihood[l] += log(total);
+      scale[l] = total > 0 ? 1 / total : 0;
+    }
+  }
+
+  for (int l = 0; l < count; ++l) {
+    vector<int> results;
+    double max = FindMostLikelyLane(j, l, &results);
+
+    cout << m_sweep_errors[l] << " " << log_likelihood[l];
+
+    for (int x = 0; x < results.size(); ++x) {
+      int row = results[x] / m_map.Width();
+      int col = results[x] - (row * m_map.Width());
+
+      cout << " (" << row << "," << col << ")";
+    }
+
+    cout << " " << max << endl;
+
+    if (log_likelihood[l] > log_likelihood[best]) {
+      best = l;
+    }
+  }
+
+  cout << "best " << m_sweep_errors[best] << endl;
+
+  return 0;
+}
+
+// Moves robot and applies observation for every candidate error
+void Robot::StepSweep(const Matrix<double> &j, Matrix<double> *r, \
+    const Matrix<double> &table, const vector<double> &scale, \
+    Matrix<double> *sums) {
+  const int width = m_map.Width();
+  const int L = j.Cols();
+  const unsigned char *cells = m_map.Cells();
+
+  m_pool->Run(m_tiles, [&](int tile) {
+    int begin, end;
+    double *sum = sums->Row(tile);
+    vector<double> total(L);
+
+    TileBounds(tile, &begin, &end);
+
+    fill(sum, sum + L, 0);
+
+    for (int x = begin; x < end; ++x) {
+      int in = m_inbound[x];
+      double *out = r->Row(x);
+      const double *plane = table.Row(cells[x]);
+
+      fill(total.begin(), total.end(), 0);
+
+      // Neighbors are summed in index order as in Predict
+      if (in & NORTH) {
+        const double *n = j.Row(x-width);
+
+        for (int l = 0; l < L; ++l) {
+          total[l] += m_move[x-width] * n[l];
+        }
+      }
+
+      if (in & WEST) {
+        const double *n = j.Row(x-1);
+
+        for (int l = 0; l < L; ++l) {
+          total[l] += m_move[x-1] * n[l];
+        }
+      }
+
+      if (in & EAST) {
+        const double *n = j.Row(x+1);
+
+        for (int l = 0; l < L; ++l) {
+          total[l] += m_move[x+1] * n[l];
+        }
+      }
+
+      if (in & SOUTH) {
+        const double *n = j.Row(x+width);
+
+        for (int l = 0; l < L; ++l) {
+          total[l] += m_move[x+width] * n[l];
+        }
+      }
+
+      for (int l = 0; l < L; ++l) {
+        out[l] = total[l] * plane[l] * scale[l];
+        sum[l] += out[l];
+      }
+    }
+  });
+}
+
+int Robot::EditCell(int row, int col, int mask) {
+  int width = m_map.Width();
+  int index = row*width+col;
+
+  if (m_map.Set(row, col, mask) == 1) {
+    return 1;
+  }
+
+  // Only the cell's own moves and its neighbors' inbound masks change
+  UpdateStencil(m_map, row, col);
+
+  if (row > 0) {
+    UpdateStencil(m_map, row-1, col);
+  }
+
+  if (row < m_map.Height()-1) {
+    UpdateStencil(m_map, row+1, col);
+  }
+
+  if (col > 0) {
+    UpdateStencil(m_map, row, col-1);
+  }
+
+  if (col < width-1) {
+    UpdateStencil(m_map, row, col+1);
+  }
+
+  for (int obs = 0; obs < m_planes.Rows(); ++obs) {
+    m_planes(obs, index) = m_likelihood[obs][mask];
+  }
+
+  for (int obs = 0; obs < m_planes_f.Rows(); ++obs) {
+    m_planes_f(obs, index) = m_likelihood[obs][mask];
+  }
+
+  if (m_move_f.size() > 0) {
+    m_move_f[index] = m_move[index];
+  }
+
+  // Requests start from the prior, which spreads over the open cells of
+  // the edited map, while a stream keeps filtering from its belief
+  if (m_mode != STREAM) {
+    InitPrior();
+  }
+
+  // Beliefs cached before the edit no longer match the map
+  if (m_cache) {
+    m_cache->Clear();
+  }
+
+  return 0;
+}
+
+int Robot::Bench() {
+  string csv_file = string(m_bench) + ".csv";
+  string json_file = string(m_bench) + ".json";
+  string text_file = string(m_bench) + "_map.txt";
+  string binary_file = string(m_bench) + "_map.bin";
+  ofstream csv(csv_file.c_str());
+  ofstream json(json_file.c_str());
+  MapGenerator generator(m_seed);
+  bool first(true);
+
+  if (csv.fail() || json.fail()) {
+    cerr << "Failed to open " << (csv.fail() ? csv_file : json_file) << endl;
+
+    return 1;
+  }
+
+  csv << "cells,height,width,density,steps,parse_text_s,load_binary_s,"
+      << "model_s,step_s,locate_s,found,p_true" << endl;
+  json << "{\"runs\": [";
+
+  m_error = kBenchError;
+
+  for (long cells = 100; cells <= m_bench_cells; cells *= 10) {
+    for (int d = 0; d < kBenchDensities; ++d) {
+      double density = kBenchDensity[d];
+      int height = (int)sqrt((double)cells);
+      int width = (int)((cells + height/2) / height);
+      vector<unsigned char> map;
+      vector<int> path;
+      chrono::steady_clock::time_point start;
+      double parse, load, model, step(0), locate, p_true;
+
+      generator.GenerateMap(height, width, density, &map);
+      generator.SimulateWalk(map, width, kBenchSteps, m_error, &path, \
+          &m_obs);
+
+      if (generator.WriteText(text_file.c_str(), height, width, map) == 1) {
+        return 1;
+      }
+
+      start = chrono::steady_clock::now();
+
+      if (ParseMap(text_file.c_str()) == 1) {
+        return 1;
+      }
+
+      parse = Seconds(start);
+
+      if (m_map.WriteBinary(binary_file.c_str()) == 1) {
+        return 1;
+      }
+
+      start = chrono::steady_clock::now();
+
+      if (ParseMap(binary_file.c_str()) == 1) {
+        return 1;
+      }
+
+      load = Seconds(start);
+      start = chrono::steady_clock::now();
+
+      InitModel();
+
+      model = Seconds(start);
+
+      for (int x = 0; x < m_obs.size(); ++x) {
+        start = chrono::steady_clock::now();
+
+        Filter(m_obs[x]);
+
+        step += Seconds(start);
+      }
+
+      step /= max((int)m_obs.size(), 1);
+
+      vector<int> results;
+
+      start = chrono::steady_clock::now();
+
+      NormalizeFilter();
+      FindMostLikelyFilter(&results);
+
+      locate = Seconds(start);
+
+      // Probability the filter gives the robot's true final state
+      int state = path.empty() ? 0 : path.back();
+      bool found = !path.empty() && \
+          find(results.begin(), results.end(), state) != results.end();
+
+      p_true = m_sparse ? 0 : m_joint[state];
+
+      for (int x = 0; m_sparse && x < m_active.size(); ++x) {
+        if (m_active[x].first == state) {
+          p_true = m_active[x].second;
+        }
+      }
+
+      csv << height * width << "," << height << "," << width << ","
+          << density << "," << m_obs.size() << "," << parse << "," << load
+          << "," << model << "," << step << "," << locate << "," << found
+          << "," << p_true << endl;
+
+      json << (first ? "" : ",") << "\n  {\"cells\": " << height * width
+           << ", \"height\": " << height << ", \"width\": " << width
+           << ", \"density\": " << density << ", \"steps\": "
+           << m_obs.size() << ", \"parse_text_s\": " << parse
+           << ", \"load_binary_s\": " << load << ", \"model_s\": " << model
+           << ", \"step_s\": " << step << ", \"locate_s\": " << locate
+           << ", \"found\": " << (found ? "true" : "false")
+           << ", \"p_true\": " << p_true << "}";
+
+      cerr << "bench: " << height << "x" << width << " density " << density
+           << " step " << step << " s" << (found ? "" : ", missed") << endl;
+
+      first = false;
+    }
+  }
+
+  json << "\n]}" << endl;
+
+  remove(text_file.c_str());
+  remove(binary_file.c_str());
+
+  return 0;
+}
+
+// Prints results
+void Robot::PrintResults(int id, double max, const vector<int> &results) {
+  PrintResults(cout, to_string(id), max, results);
+
+  // Flushes so consumers on a pipe see each line immediately
+  cout << endl;
+}
+
+void Robot::PrintResults(ostream &os, const string &id, double max, \
+    const vector<int> &results) {
+  os << id;
+
+  for (int x = 0; x < results.size(); ++x) {
+    int row = results[x] / m_map.Width();
+    int col = results[x] - (row * m_map.Width());
+
+    os << " (" << row << "," << col << ")";
+  }
+
+  os << " " << max;
+}
+
+// Prints top states
+void Robot::PrintTopK(int id, const vector<pair<double, int> > &top) {
+  cout << id;
+
+  for (int x = 0; x < top.size(); ++x) {
+    int row = top[x].second / m_map.Width();
+    int col = top[x].second - (row * m_map.Width());
+
+    cout << " (" << row << "," << col << ") " << top[x].first;
+  }
+
+  cout << endl;
+}
+
+// Moves robot and applies observations of each lane
+void Robot::StepBatch(const Matrix<double> &j, Matrix<double> *r, \
+    const double *const *planes) {
+  PROFILE_SCOPE("StepBatch");
+
+  const int width = m_map.Width();
+  const int L = kBatchLanes;
+
+  for (int x = 0; x < j.Rows(); ++x) {
+    int in = m_inbound[x];
+    double *out = r->Row(x);
+    double total[kBatchLanes] = { 0 };
+
+    // Neighbors are summed in index order as in Predict
+    if (in & NORTH) {
+      const double *n = j.Row(x-width);
+
+      for (int l = 0; l < L; ++l) {
+        total[l] += m_move[x-width] * n[l];
+      }
+    }
+
+    if (in & WEST) {
+      const double *n = j.Row(x-1);
+
+      for (int l = 0; l < L; ++l) {
+        total[l] += m_move[x-1] * n[l];
+      }
+    }
+
+    if (in & EAST) {
+      const double *n = j.Row(x+1);
+
+      for (int l = 0; l < L; ++l) {
+        total[l] += m_move[x+1] * n[l];
+      }
+    }
+
+    if (in & SOUTH) {
+      const double *n = j.Row(x+width);
+
+      for (int l = 0; l < L; ++l) {
+        total[l] += m_move[x+width] * n[l];
+      }
+    }
+
+    for (int l = 0; l < L; ++l) {
+      out[l] = total[l] * planes[l][x];
+    }
+  }
+}
+
+// Returns highest normalized probability of lane
+double Robot::FindMostLikelyLane(const Matrix<double> &j, int lane, \
+    vector<int> *results) {
+  int begin, end;
+  double max(0), total(0);
+
+  // Sums tile by tile to match Normalize
+  for (int tile = 0; tile < m_tiles; ++tile) {
+    double sum(0);
+
+    TileBounds(tile, &begin, &end);
+
+    for (int x = begin; x < end; ++x) {
+      sum += j(x, lane);
+    }
+
+    total += sum;
+  }
+
+  results->clear();
+
+  for (int x = 0; x < j.Rows(); ++x) {
+    double value = j(x, lane) / total;
+
+    if (value > max * (1 + kTieTolerance)) {
+      results->clear();
+    }
+
+    if (value >= max * (1 - kTieTolerance)) {
+      results->push_back(x);
+    }
+
+    if (value > max) {
+      max = value;
+    }
+  }
+
+  // Drops states only close to an earlier maximum
+  int kept(0);
+
+  for (int x = 0; x < results->size(); ++x) {
+    if (j((*results)[x], lane) / total >= max * (1 - kTieTolerance)) {
+      (*results)[kept++] = (*results)[x];
+    }
+  }
+
+  results->resize(kept);
+
+  return max;
+}
+
+// Returns highest probability
+template<typename T>
+double Robot::FindMostLikely(const vector<T> &j, vector<int> *results) {
+  double max(0);
+  double tolerance = std::max(kTieTolerance, \
+      64 * (double)numeric_limits<T>::epsilon());
+
+  // Create a vector containing states
+  // close to the highest probability of each tile
+  m_pool->Run(m_tiles, [&](int tile) {
+    int begin, end;
+    double tile_max(0);
+    vector<int> &tile_results = m_tile_results[tile];
+
+    TileBounds(tile, &begin, &end);
+
+    tile_results.clear();
+
+    for (int x = begin; x < end; ++x) {
+      if (j[x] > tile_max * (1 + tolerance)) {
+        tile_results.clear();
+      }
+
+      if (j[x] >= tile_max * (1 - tolerance)) {
+        tile_results.push_back(x);
+      }
+
+      if (j[x] > tile_max) {
+        tile_max = j[x];
+      }
+    }
+
+    m_tile_max[tile] = tile_max;
+  });
+
+  for (int tile = 0; tile < m_tiles; ++tile) {
+    if (m_tile_max[tile] > max) {
+      max = m_tile_max[tile];
+    }
+  }
+
+  results->clear();
+
+  // Merges tiles in order so states are listed as a serial scan would
+  for (int tile = 0; tile < m_tiles; ++tile) {
+    for (int x = 0; x < m_tile_results[tile].size(); ++x) {
+      int state = m_tile_results[tile][x];
+
+      if (j[state] >= max * (1 - tolerance)) {
+        results->push_back(state);
+      }
+    }
+  }
+
+  return max;
+}
+
+// Initializes sensory matrix using the following equation
+// p(e|s) = error^d * (1-error)^x-d
+// error: sensor error
+// d: Difference between state and observation
+// x: Max differences between state and observation
+void Robot::InitSensoryMatrix(double error, Matrix<double> *s) {
+  for (int x = 0; x < 5; ++x) {
+    (*s)(x, 0) = pow(error, x) * pow(1-error, 4-x);
+  }
+}
+
+// Initializes transition stencil
+void Robot::InitTransitionStencil(const GridMap &m) {
+  PROFILE_SCOPE("InitTransitionStencil");
+
+  int width = m.Width();
+  int height = m.Height();
+  int states = m.States();
+
+  const unsigned char *cells = m.Cells();
+
+  m_move.assign(states, 0);
+  m_inbound.assign(states, 0);
+  m_outbound.assign(states, 0);
+
+  // States without valid paths never move
+  for (int mask = 0; mask < 16; ++mask) {
+    m_log_move[mask] = kOpenSides[mask] > 0 ? -log((double)kOpenSides[mask]) \
+        : -numeric_limits<double>::infinity();
+  }
+
+  // Interior states have all four neighbors on the map, so each is a
+  // few table lookups and shifts without branches
+  for (int x = 1; x < height-1; ++x) {
+    const unsigned char *c = cells + x*width;
+    double *move = &m_move[x*width];
+    unsigned char *in = &m_inbound[x*width];
+    unsigned char *out = &m_outbound[x*width];
+
+    for (int y = 1; y < width-1; ++y) {
+      move[y] = kMoveProbability[c[y]];
+      out[y] = ~c[y] & 0xf;
+      // Open south side of the north neighbor lets it move in, and so on
+      in[y] = ((~c[y-width] & SOUTH) << 1) | ((~c[y+width] & NORTH) >> 1) | \
+          ((~c[y-1] & EAST) << 1) | ((~c[y+1] & WEST) >> 1);
+    }
+  }
+
+  // States on the border drop moves leading off the map
+  for (int y = 0; y < width; ++y) {
+    UpdateStencil(m, 0, y);
+    UpdateStencil(m, height-1, y);
+  }
+
+  for (int x = 1; x < height-1; ++x) {
+    UpdateStencil(m, x, 0);
+    UpdateStencil(m, x, width-1);
+  }
+}
+
+// Applies transition stencil
+template<typename T>
+void Robot::Predict(const vector<T> &j, vector<T> *r, int begin, int end) {
+  int width = m_map.Width();
+  const vector<T> &move = Moves<T>();
+
+  for (int x = begin; x < end; ++x) {
+    int in = m_inbound[x];
+    T total(0);
+
+    // Neighbors are summed in index order
+    if (in & NORTH) {
+      total += move[x-width] * j[x-width];
+    }
+
+    if (in & WEST) {
+      total += move[x-1] * j[x-1];
+    }
+
+    if (in & EAST) {
+      total += move[x+1] * j[x+1];
+    }
+
+    if (in & SOUTH) {
+      total += move[x+width] * j[x+width];
+    }
+
+    (*r)[x] = total;
+  }
+}
+
+// Applies observation and transition stencil backwards
+void Robot::StepBackward(int obs, vector<double> *b) {
+  int width = m_map.Width();
+  const double *plane = m_planes.Row(obs);
+
+  m_pool->Run(m_tiles, [&](int tile) {
+    int begin, end;
+    const vector<double> &j = *b;
+
+    TileBounds(tile, &begin, &end);
+
+    for (int x = begin; x < end; ++x) {
+      int out = m_outbound[x];
+      double total(0);
+
+      if (out & NORTH) {
+        total += plane[x-width] * j[x-width];
+      }
+
+      if (out & WEST) {
+        total += plane[x-1] * j[x-1];
+      }
+
+      if (out & EAST) {
+        total += plane[x+1] * j[x+1];
+      }
+
+      if (out & SOUTH) {
+        total += plane[x+width] * j[x+width];
+      }
+
+      m_predict[x] = m_move[x] * total;
+    }
+  });
+
+  b->swap(m_predict);
+}
+
+// Moves robot and applies observation in log space
+void Robot::StepViterbi(int obs, const vector<double> &d, vector<double> *r, \
+    unsigned char *back) {
+  int width = m_map.Width();
+  const unsigned char *cells = m_map.Cells();
+  const double *log_likelihood = m_log_likelihood[obs];
+
+  // Codes are collected one byte per state then packed
+  m_pool->Run(m_tiles, [&](int tile) {
+    int begin, end;
+
+    TileBounds(tile, &begin, &end);
+
+    for (int x = begin; x < end; ++x) {
+      int in = m_inbound[x];
+      int code(FROM_NORTH);
+      double best = -numeric_limits<double>::infinity();
+
+      // Ties go to the predecessor with the lowest index
+      if (in & NORTH) {
+        best = d[x-width] + m_log_move[cells[x-width]];
+      }
+
+      if ((in & WEST) && d[x-1] + m_log_move[cells[x-1]] > best) {
+        best = d[x-1] + m_log_move[cells[x-1]];
+        code = FROM_WEST;
+      }
+
+      if ((in & EAST) && d[x+1] + m_log_move[cells[x+1]] > best) {
+        best = d[x+1] + m_log_move[cells[x+1]];
+        code = FROM_EAST;
+      }
+
+      if ((in & SOUTH) && d[x+width] + m_log_move[cells[x+width]] > best) {
+        best = d[x+width] + m_log_move[cells[x+width]];
+        code = FROM_SOUTH;
+      }
+
+      (*r)[x] = best + log_likelihood[cells[x]];
+      m_codes[x] = code;
+    }
+  });
+
+  if (back == NULL) {
+    return;
+  }
+
+  // Each tile packs the bytes whose first state it covers
+  m_pool->Run(m_tiles, [&](int tile) {
+    int begin, end;
+    int states = m_codes.size();
+
+    TileBounds(tile, &begin, &end);
+
+    begin = (begin + kBackpointersPerByte - 1) / kBackpointersPerByte;
+    end = (end + kBackpointersPerByte - 1) / kBackpointersPerByte;
+
+    for (int b = begin; b < end; ++b) {
+      int byte(0);
+
+      for (int i = 0; i < kBackpointersPerByte; ++i) {
+        int x = b * kBackpointersPerByte + i;
+
+        if (x < states) {
+          byte |= m_codes[x] << (2 * i);
+        }
+      }
+
+      back[b] = byte;
+    }
+  });
+}
+
+// Updates stencil of state
+void Robot::UpdateStencil(const GridMap &m, int x, int y) {
+  int width = m.Width();
+  int height = m.Height();
+  int index = x*width+y;
+
+  // Determines move probability of the state
+  m_move[index] = kMoveProbability[m.At(x, y)];
+  m_outbound[index] = 0;
+  m_inbound[index] = 0;
+
+  // Determines which neighbors can move into the state, moves leading
+  // off the map are dropped
+
+  // Moves leaving the state
+  if (x > 0 && (m.At(x, y) & NORTH) == 0x0) {
+    m_outbound[index] |= NORTH;
+  }
+
+  if (x < height-1 && (m.At(x, y) & SOUTH) == 0x0) {
+    m_outbound[index] |= SOUTH;
+  }
+
+  if (y > 0 && (m.At(x, y) & WEST) == 0x0) {
+    m_outbound[index] |= WEST;
+  }
+
+  if (y < width-1 && (m.At(x, y) & EAST) == 0x0) {
+    m_outbound[index] |= EAST;
+  }
+
+  // Neighbor to the north moving south
+  if (x > 0 && (m.At(x-1, y) & SOUTH) == 0x0) {
+    m_inbound[index] |= NORTH;
+  }
+
+  // Neighbor to the south moving north
+  if (x < height-1 && (m.At(x+1, y) & NORTH) == 0x0) {
+    m_inbound[index] |= SOUTH;
+  }
+
+  // Neighbor to the west moving east
+  if (y > 0 && (m.At(x, y-1) & EAST) == 0x0) {
+    m_inbound[index] |= WEST;
+  }
+
+  // Neighbor to the east moving west
+  if (y < width-1 && (m.At(x, y+1) & WEST) == 0x0) {
+    m_inbound[index] |= EAST;
+  }
+}
+
+// Initializes likelihood table
+void Robot::InitLikelihoodTable(Matrix<double> &s) {
+  PROFILE_SCOPE("InitLikelihoodTable");
+
+  for (int obs = 0; obs < 16; ++obs) {
+    for (int state = 0; state < 16; ++state) {
+      // Determines difference between state and observation
+      m_likelihood[obs][state] = s(CalcObsStateDiff(state, obs), 0);
+      m_log_likelihood[obs][state] = log(m_likelihood[obs][state]);
+    }
+  }
+}
+
+// Initializes observation planes
+void Robot::InitObsPlanes(const GridMap &m) {
+  PROFILE_SCOPE("InitObsPlanes");
+
+  int states = m.States();
+  const unsigned char *cells = m.Cells();
+
+  m_planes.Resize(16, states);
+
+  for (int obs = 0; obs < 16; ++obs) {
+    double *plane = m_planes.Row(obs);
+
+    for (int x = 0; x < states; ++x) {
+      plane[x] = m_likelihood[obs][cells[x]];
+    }
+  }
+}
+
+// Applies observation
+template<typename T>
+void Robot::Observe(int obs, vector<T> *j, int begin, int end) {
+  const T *plane = Planes<T>().Row(obs);
+
+  for (int x = begin; x < end; ++x) {
+    (*j)[x] *= plane[x];
+  }
+}
+
+// Normalizes joint matrix
+template<typename T>
+void Robot::Normalize(vector<T> *j) {
+  double total(0);
+
+  // Sums each tile in parallel
+  m_pool->Run(m_tiles, [&](int tile) {
+    int begin, end;
+    double sum(0);
+
+    TileBounds(tile, &begin, &end);
+
+    for (int x = begin; x < end; ++x) {
+      sum += (*j)[x];
+    }
+
+    m_tile_sums[tile] = sum;
+  });
+
+  for (int tile = 0; tile < m_tiles; ++tile) {
+    total += m_tile_sums[tile];
+  }
+
+  m_pool->Run(m_tiles, [&](int tile) {
+    int begin, end;
+
+    TileBounds(tile, &begin, &end);
+
+    for (int x = begin; x < end; ++x) {
+      (*j)[x] /= total;
+    }
+  });
+}
+
+// Returns difference between state and observation
+int Robot::CalcObsStateDiff(int state, int obs) {
+  return kMaskDistance[state & 0xf][obs & 0xf];
+}
+
+// Returns valid paths of a given state
+int Robot::CountValidPaths(int state) {
+  return kOpenSides[state & 0xf];
+}
+
+// Returns valid states in a map
+int Robot::CountValidStates(const GridMap &m) {
+  int value(0);
+  int states = m.States();
+  const unsigned char *cells = m.Cells();
+
+  // Counted without branches so the pass vectorizes
+  for (int x = 0; x < states; ++x) {
+    value += cells[x] != 0xf;
+  }
+
+  return value;
+}
+
+int Robot::ParseMap(const char *file) {
+  PROFILE_SCOPE("ParseMap");
+
+  return m_map.Load(file);
+}
+
+int Robot::ParseSequences(const char *file) {
+  string line, token;
+  ifstream ifs(file);
+
+  if (ifs.fail()) {
+    cerr << "Failed to open " << file << endl; 
+
+    return 1;
+  }
+
+  while (getline(ifs, line)) {
+    istringstream iss(line);
+    vector<int> seq;
+
+    while (iss >> token) {
+      seq.push_back(ParseObs(token.c_str()));
+    }
+
+    if (!seq.empty()) {
+      m_sequences.push_back(seq);
+    }
+  }
+
+  ifs.close();
+
+  return 0;
+}
+
+int Robot::ParseObsFile(const char *file) {
+  string token;
+  ifstream ifs(file);
+
+  if (ifs.fail()) {
+    cerr << "Failed to open " << file << endl; 
+
+    return 1;
+  }
+
+  while (ifs >> token) {
+    m_obs.push_back(ParseObs(token.c_str()));
   }
 
-  ifs.close(); 
+  ifs.close();
 
   return 0;
 }
@@ -414,12 +3880,44 @@ int Robot::ParseObs(const char *obs) {
 
 void Robot::PrintUsage() {
   cout << "./robot <input file> <error> <obs1> <obs2>..." << endl;
+  cout << "./robot --stream <input file> <error> < observations" << endl;
+  cout << "./robot --batch <sequences file> <input file> <error>" << endl;
+  cout << "./robot --smooth <input file> <error> <obs1> <obs2>..." << endl;
+  cout << "./robot --viterbi <input file> <error> <obs1> <obs2>..." << endl;
+  cout << "./robot --convert <binary file> <input file>" << endl;
+  cout << "./robot --particles <count> <input file> <error> <obs1> <obs2>..."
+       << endl;
+  cout << "./robot --pyramid <levels> <input file> <error> <obs1> <obs2>..."
+       << endl;
+  cout << "./robot --server [--socket <path>] <name>=<input file>..." << endl;
+  cout << "./robot --float <input file> <error> <obs1> <obs2>..." << endl;
+  cout << "./robot --sweep <min> <max> <count> <input file> <obs1> <obs2>..."
+       << endl;
+  cout << "./robot --bench <output prefix> [--bench-cells <cells>]" << endl;
+  cout << "Options:" << endl;
+  cout << "  --obs <file>       reads observations from file" << endl;
+  cout << "  --memory <MB>      Viterbi backpointer budget before checkpointing"
+       << endl;
+  cout << "  --prune <fraction> drops states below fraction of the most likely"
+       << endl;
+  cout << "  --top <k>          prints the k most probable states" << endl;
+  cout << "  --seed <seed>      random seed of the particle filter" << endl;
+  cout << "  --cache <MB>       caches beliefs of observation prefixes in "
+       << "batch and server modes" << endl;
+  cout << "  --refine <fraction> refines blocks above fraction of the most "
+       << "likely" << endl;
+  cout << "  --compare          reports error of approximate modes against "
+       << "the grid filter" << endl;
+  cout << "  --threads <count>  threads used by the belief update, 0 for all"
+       << endl;
+  cout << "  --profile <file>   writes per-phase counters as JSON, needs "
+       << "make PROFILE=1" << endl;
 }
 
-void Robot::PrintMatrix(Matrix<double> &m) {
-  for (int x = 0; x < m.size(); ++x) {
-    for (int y = 0; y < m[x].size(); ++y) {
-      cout << m[x][y] << "\t";
+void Robot::PrintMatrix(const Matrix<double> &m) {
+  for (int x = 0; x < m.Rows(); ++x) {
+    for (int y = 0; y < m.Cols(); ++y) {
+      cout << m(x, y) << "\t";
     }
 
     cout << endl;
@@ -433,5 +3931,5 @@ int main(int argc, char **argv) {
     return 1;
   } 
  
-  return robot.Localize();
+  return robot.Run();
 }
@@ -0,0 +1,104 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads)
+  : m_call(NULL), m_fn(NULL), m_tasks(0), m_next(0), m_active(0), m_batch(0),
+    m_stop(false) {
+  if (threads <= 0) {
+    threads = thread::hardware_concurrency();
+  }
+
+  for (int i = 1; i < threads; ++i) {
+    m_workers.push_back(thread(&ThreadPool::Work, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(m_mutex);
+
+    m_stop = true;
+  }
+
+  m_wake.notify_all();
+
+  for (int i = 0; i < m_workers.size(); ++i) {
+    m_workers[i].join();
+  }
+}
+
+int ThreadPool::Size() const {
+  return m_workers.size() + 1;
+}
+
+void ThreadPool::RunTasks(int tasks, void (*call)(const void *, int), \
+    const void *fn) {
+  // Small batches are not worth waking the workers for
+  if (tasks <= 1 || m_workers.empty()) {
+    for (int i = 0; i < tasks; ++i) {
+      call(fn, i);
+    }
+
+    return;
+  }
+
+  {
+    lock_guard<mutex> lock(m_mutex);
+
+    m_call = call;
+    m_fn = fn;
+    m_tasks = tasks;
+    m_next = 0;
+    m_active = m_workers.size();
+    ++m_batch;
+  }
+
+  m_wake.notify_all();
+
+  Drain();
+
+  // Waits for workers so fn stays valid while they use it
+  unique_lock<mutex> lock(m_mutex);
+
+  m_done.wait(lock, [this] { return m_active == 0; });
+
+  m_call = NULL;
+  m_fn = NULL;
+}
+
+void ThreadPool::Work() {
+  unsigned batch(0);
+
+  while (true) {
+    {
+      unique_lock<mutex> lock(m_mutex);
+
+      m_wake.wait(lock, [&] { return m_stop || m_batch != batch; });
+
+      if (m_stop) {
+        return;
+      }
+
+      batch = m_batch;
+    }
+
+    Drain();
+
+    {
+      lock_guard<mutex> lock(m_mutex);
+
+      if (--m_active == 0) {
+        m_done.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::Drain() {
+  int task;
+
+  while ((task = m_next++) < m_tasks) {
+    m_call(m_fn, task);
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef PROJECT1_THREAD_POOL_H_
+#define PROJECT1_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads running indexed tasks
+//
+// Example usage:
+// ThreadPool pool(4);
+// pool.Run(tiles, [&](int tile) { ... });
+//
+// Tasks are handed out dynamically so callers wanting reproducible
+// results must store per task results by index and combine them in
+// index order
+class ThreadPool {
+  public:
+    // Starts threads-1 workers, the calling thread is the last worker
+    // A value of 0 uses every hardware thread
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    // Returns the number of threads including the caller
+    int Size() const;
+    // Calls fn(task) for every task in [0, tasks) and returns once
+    // all of them have completed
+    //
+    // fn is called through a plain function pointer rather than a
+    // std::function, so a call allocates nothing whatever fn captures
+    template<typename F>
+    void Run(int tasks, const F &fn) {
+      RunTasks(tasks, &CallTask<F>, &fn);
+    }
+
+  private:
+    // Calls task of the callable of type F at fn
+    template<typename F>
+    static void CallTask(const void *fn, int task) {
+      (*static_cast<const F *>(fn))(task);
+    }
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    // Callable of the current batch and the function calling it
+    void (*m_call)(const void *, int);
+    const void *m_fn;
+    int m_tasks;
+    std::atomic<int> m_next;
+    // Workers still running the current batch
+    int m_active;
+    // Incremented for every batch so workers only wake once per batch
+    unsigned m_batch;
+    bool m_stop;
+
+    // Runs call(fn, task) for every task as Run describes
+    void RunTasks(int tasks, void (*call)(const void *, int), \
+        const void *fn);
+    // Worker thread loop
+    void Work();
+    // Runs tasks of the current batch until none remain
+    void Drain();
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+};
+
+#endif // PROJECT1_THREAD_POOL_H_
@@ -21,20 +21,37 @@
 //SOFTWARE.
 
 #include "em.h"
+#include "parallel_viterbi.h"
+#include "viterbi_decoder.h"
 
+#include <algorithm>
+#include <atomic>
+#include <dirent.h>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <math.h>
 #include <limits>
+#include <sstream>
+#include <string.h>
+#include <sys/stat.h>
 
 using namespace std;
 
-// Alpha representation of states in hidden Markov model
-const char *kModelStates[] = { "B", "L", "M" };
+// Observations whose states may be undecided at once while decoding
+const int kTracebackDepth = 1 << 16;
 
-// Alpha representation of observations in hidden Markov model
-const char *kModelObservations[] = { "H", "T" };
+// Observations read from a stream at once
+const int kStreamBlock = 1 << 16;
+
+// Alpha representation of states in hidden Markov model when the
+// transition file does not name them
+const char kModelStates[] = "BLM";
+
+// Alpha representation of observations in hidden Markov model when the
+// sensory file does not name them
+const char kModelObservations[] = "HT";
 
 // Default constructor
 // Initializes all matrices needed for setup
@@ -42,60 +59,77 @@ EM::EM()
   : observations_(1),
     transition_(3, vector<double>(3, 0)),
     sensory_(3, vector<double>(2, 0)),
-    original_(1) {
+    original_(1),
+    decode_threads_(-1),
+    train_threads_(0) {
+  SetAlphabet(kModelStates, &states_, state_index_);
+  SetAlphabet(kModelObservations, &symbols_, symbol_index_);
+
   cout << fixed << setprecision(6);
 }
 
-// Iterates over contents of a file building a
+// Iterates over contents of a file or directory building a
 // matrix containing observation data
 int EM::ParseObservations(const char *file) {
-  char c; 
-  ifstream ifs(file);
-
-  while (ifs.get(c)) {
-    if (c == 'H') {
-      observations_[0].push_back(0);
-    } else if (c == 'T') {
-      observations_[0].push_back(1);
-    }
-  }
-
-  ifs.close();
+  observations_.clear();
 
-  return 0;
+  return ParseSequences(file, symbol_index_, &observations_);
 }
 
 // Iterates over contents of a file building a
 // matrix containing transition data
 int EM::ParseTransition(const char *file) {
-  int l, r;
-  int x, y; 
-  string line;
+  string line, names;
+  matrix<double> rows;
   ifstream ifs(file);
 
-  l = x = y = 0;
+  if (ifs.fail()) {
+    error("Failed to open %s", file);
 
-  while (ifs.good()) {
-    l = r = y = 0; 
-   
-    getline(ifs, line);
+    return 1;
+  }
+
+  while (getline(ifs, line)) {
+    double value;
+    istringstream iss(line);
+    vector<double> row;
 
-    if (line.empty()) {
+    if (line.empty() || ParseAlphabet(line, "states:", &names)) {
       continue;
     }
 
-    while ((r = line.find(' ', l)) != -1) {
-      transition_[x][y++] = -log2(atof(line.substr(l, r - l).c_str()));
+    while (iss >> value) {
+      row.push_back(-log2(value));
+    }
 
-      l = r + 1;
+    if (!row.empty()) {
+      rows.push_back(row);
     }
+  }
 
-    transition_[x][y] = -log2(atof(line.substr(l, line.length() - r).c_str()));
+  ifs.close(); 
 
-    ++x;
+  if (names.empty() && rows.size() == strlen(kModelStates)) {
+    names = kModelStates;
   }
 
-  ifs.close(); 
+  if (names.size() != rows.size()) {
+    error("Expected %d state names in %s", (int)rows.size(), file);
+
+    return 1;
+  }
+
+  for (int x = 0; x < rows.size(); ++x) {
+    if (rows[x].size() != rows.size()) {
+      error("Expected %d values on row %d of %s", (int)rows.size(), x, file);
+
+      return 1;
+    }
+  }
+
+  transition_ = rows;
+
+  SetAlphabet(names, &states_, state_index_);
   
   return 0;
 }
@@ -103,42 +137,146 @@ int EM::ParseTransition(const char *file) {
 // Iterates over contents of a file building a 
 // matrix containing sensory data
 int EM::ParseSensory(const char *file) {
-  int r(0);
-  string line; 
+  string line, names;
+  matrix<double> rows;
   ifstream ifs(file);
+
+  if (ifs.fail()) {
+    error("Failed to open %s", file);
+
+    return 1;
+  }
   
-  while (ifs.good()) {
-    getline(ifs, line);
-   
-    if (line.empty()) {
+  while (getline(ifs, line)) {
+    double value;
+    istringstream iss(line);
+    vector<double> row;
+
+    if (line.empty() || ParseAlphabet(line, "symbols:", &names)) {
       continue;
     }
 
-    sensory_[r][0] = -log2(atof(line.substr(0, line.length()).c_str())); 
-    sensory_[r++][1] = -log2(1 - atof(line.substr(0, line.length()).c_str())); 
+    while (iss >> value) {
+      row.push_back(value);
+    }
+
+    if (!row.empty()) {
+      rows.push_back(row);
+    }
   } 
 
   ifs.close();
 
+  if (names.empty()) {
+    names = kModelObservations;
+  }
+
+  if (rows.size() != States()) {
+    error("Expected %d rows in %s", States(), file);
+
+    return 1;
+  }
+
+  for (int x = 0; x < rows.size(); ++x) {
+    // Two symbols may be given by the probability of the first
+    if (rows[x].size() == 1 && names.size() == 2) {
+      rows[x].push_back(1 - rows[x][0]);
+    }
+
+    if (rows[x].size() != names.size()) {
+      error("Expected %d values on row %d of %s", (int)names.size(), x, file);
+
+      return 1;
+    }
+
+    for (int y = 0; y < rows[x].size(); ++y) {
+      rows[x][y] = -log2(rows[x][y]);
+    }
+  }
+
+  sensory_ = rows;
+
+  SetAlphabet(names, &symbols_, symbol_index_);
+
   return 0;
 }
 
-// Iterates over contents of a file building a 
+// Iterates over contents of a file or directory building a 
 // matrix containing original states
 int EM::ParseOriginal(const char *file) {
-  char c; 
+  original_.clear();
+
+  return ParseSequences(file, state_index_, &original_);
+}
+
+// Reads a sequence from each line of file, or of each file in it when
+// file is a directory
+int EM::ParseSequences(const char *file, const int *index, \
+    matrix<int> *sequences) {
+  DIR *dir;
+  struct dirent *entry;
+  struct stat st;
+  vector<string> files;
+
+  if (stat(file, &st) != 0) {
+    error("Failed to open %s", file);
+
+    return 1;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    return ReadSequences(file, index, sequences);
+  }
+
+  if ((dir = opendir(file)) == NULL) {
+    error("Failed to open %s", file);
+
+    return 1;
+  }
+
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.') {
+      files.push_back(string(file) + "/" + entry->d_name);
+    }
+  }
+
+  closedir(dir);
+
+  // Sorted so observation and original files pair up by name
+  sort(files.begin(), files.end());
+
+  for (int x = 0; x < files.size(); ++x) {
+    if (ReadSequences(files[x].c_str(), index, sequences)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+// Reads a sequence from each line of file
+int EM::ReadSequences(const char *file, const int *index, \
+    matrix<int> *sequences) {
   string line;
   ifstream ifs(file);
 
-  while (ifs.good()) {
-    ifs.get(c);
-
-    if (c == 'B') {
-      original_[0].push_back(0); 
-    } else if (c == 'L') {
-      original_[0].push_back(1); 
-    } else if (c == 'M') {
-      original_[0].push_back(2); 
+  if (ifs.fail()) {
+    error("Failed to open %s", file);
+
+    return 1;
+  }
+
+  while (getline(ifs, line)) {
+    vector<int> seq;
+
+    for (int x = 0; x < line.size(); ++x) {
+      if (index[(unsigned char)line[x]] != -1) {
+        seq.push_back(index[(unsigned char)line[x]]);
+      }
+    }
+
+    if (!seq.empty()) {
+      sequences->push_back(seq);
     }
   }
 
@@ -162,22 +300,22 @@ void EM::PrintMatrix(matrix<T> m) {
 }
 
 // Prints states matrix
-void EM::PrintStateMatrix(matrix<int> m) {
+void EM::PrintStateMatrix(const matrix<int> &m) {
   cout << " ";
 
   for (int i = 0; i < m[0].size(); ++i) {
-    cout << kModelStates[m[0][i]] << " ";
+    cout << states_[m[0][i]] << " ";
   }
   
   cout << endl;
 }
 
 // Prints observation matrix
-void EM::PrintObservationMatrix(matrix<int> m) {
+void EM::PrintObservationMatrix(const matrix<int> &m) {
   cout << " ";
 
   for (int i = 0; i < m[0].size(); i++) {
-    cout << kModelObservations[m[0][i]];
+    cout << symbols_[m[0][i]];
   }
 
   cout << endl;
@@ -185,28 +323,70 @@ void EM::PrintObservationMatrix(matrix<int> m) {
 
 // Calculates EM over x iterations
 int EM::CalculateEM(int iterations) {
-  matrix(vit, double, 3, observations_[0].size()+1);
-  matrix(back_trace, int, 3, observations_[0].size()+1);
-  matrix(state_seq, int, 1, observations_[0].size()+1);
+  matrix<int> state_seq;
+  ExpectedCounts counts(States(), Symbols());
   
-  for (int x = 0; x < 3; ++x) {
-    vit[x][0] = -log2((double)1/(double)3);
-  }  
+  PopulateLikelyStateSequence(&state_seq, &counts);
   
-  PopulateViterbiMatrix(&vit, &back_trace);
+  for (int i = 0; i < iterations; ++i) {
+    UpdateFromCounts(counts);
+
+    counts = ExpectedCounts(States(), Symbols());
+
+    PopulateLikelyStateSequence(&state_seq, &counts);
+  }
+
+  ReportModel(state_seq);
+
+  return 0;
+}
+
+// Calculates Baum-Welch over x iterations
+int EM::CalculateBaumWelch(int iterations) {
+  matrix<int> state_seq;
+  int threads = Pool()->Size();
 
-  PopulateLikelyStateSequence(vit, back_trace, &state_seq);
-  
   for (int i = 0; i < iterations; ++i) {
-    UpdateTransitionMatrix(state_seq);
-   
-    UpdateSensoryMatrix(state_seq);
+    ExpectedCounts counts(States(), Symbols());
+
+    // A single sequence is split over threads, otherwise each thread
+    // takes whole sequences into counts of its own
+    if (observations_.size() == 1) {
+      ForwardBackward fb(transition_, sensory_, Pool());
+
+      fb.Expect(observations_[0].data(), observations_[0].size(), &counts);
+    } else {
+      vector<ForwardBackward> fbs(threads, \
+          ForwardBackward(transition_, sensory_, NULL));
+      vector<ExpectedCounts> partial(threads, counts);
+
+      ForEachSequence(threads, [&](int t, int s) {
+        fbs[t].Expect(observations_[s].data(), observations_[s].size(), \
+            &partial[t]);
+      });
+
+      for (int t = 0; t < threads; ++t) {
+        counts.Add(partial[t]);
+      }
+    }
 
-    PopulateViterbiMatrix(&vit, &back_trace);
+    UpdateFromCounts(counts);
 
-    PopulateLikelyStateSequence(vit, back_trace, &state_seq);
+    cout << "Iteration " << i + 1 << " log-likelihood: " \
+         << counts.log_likelihood << endl;
   }
-  
+
+  cout << endl;
+
+  PopulateLikelyStateSequence(&state_seq, NULL);
+
+  ReportModel(state_seq);
+
+  return 0;
+}
+
+// Prints learned model
+void EM::ReportModel(const matrix<int> &state_seq) {
   UndoLog2Matrix(&transition_);
   UndoLog2Matrix(&sensory_);  
 
@@ -218,8 +398,6 @@ int EM::CalculateEM(int iterations) {
   PrintMatrix(sensory_);
   cout << endl << "Accuracy:" << endl;
   cout << setprecision(2) << " " << CalculateClassifierAccuracy(state_seq) * 100 << "%" << endl;
-
-  return 0;
 }
 
 // Undoes log base 2 on a matrix
@@ -232,153 +410,229 @@ void EM::UndoLog2Matrix(matrix<double> *matrix) {
 }
 
 // Calculates accuracy of em classifier
-double EM::CalculateClassifierAccuracy(matrix<int> state_seq) {
-  int match(0);
+double EM::CalculateClassifierAccuracy(const matrix<int> &state_seq) {
+  long match(0), total(0);
   
-  for (int x = 0; x < original_[0].size(); ++x) {
-    if (state_seq[0][x+1] == original_[0][x]) {
-      ++match;
+  for (int s = 0; s < original_.size() && s < state_seq.size(); ++s) {
+    for (int x = 0; x < original_[s].size(); ++x) {
+      if (x + 1 < state_seq[s].size() && \
+          state_seq[s][x+1] == original_[s][x]) {
+        ++match;
+      }
     }
+
+    total += original_[s].size();
   }
 
-  return (double)match/(double)original_[0].size();
+  return total > 0 ? (double)match/(double)total : 0;
 }
 
-// Backtraces through matrix create by Viterbi algorithm
-void EM::PopulateLikelyStateSequence(matrix<double> vit, matrix<int> back_trace, matrix<int> *state_seq) {
-  int index;
-  double min = numeric_limits<double>::max();
-  
-  for (int x = 0; x < vit.size(); ++x) {
-    if (vit[x][vit[0].size()-1] < min) {
-      index = x;
+// Decodes most likely state sequences
+void EM::PopulateLikelyStateSequence(matrix<int> *state_seq, \
+    ExpectedCounts *counts) {
+  // Parallel decoding splits each sequence over the threads instead
+  int threads = decode_threads_ >= 0 ? 1 : Pool()->Size();
+  vector<ExpectedCounts> partial(threads, ExpectedCounts(States(), Symbols()));
 
-      min = vit[x][vit[0].size()-1];
-    }
+  state_seq->resize(observations_.size());
+
+  ForEachSequence(threads, [&](int t, int s) {
+    DecodeSequence(observations_[s], &(*state_seq)[s]);
+
+    CountStates(observations_[s], (*state_seq)[s], &partial[t]);
+  });
+
+  for (int t = 0; counts != NULL && t < threads; ++t) {
+    counts->Add(partial[t]);
   }
+}
 
-  (*state_seq)[0][(*state_seq)[0].size()-1] = index; 
+// Decodes most likely state sequence
+void EM::DecodeSequence(const vector<int> &obs, vector<int> *states) {
+  vector<double> start(States(), -log2((double)1/(double)States()));
 
-  for (int x = (*state_seq)[0].size()-1; x > 0; --x) {
-    index = back_trace[index][x];
+  if (decode_threads_ >= 0) {
+    ParallelViterbi viterbi(transition_, sensory_, Pool());
 
-    (*state_seq)[0][x-1] = index;
+    viterbi.Decode(obs.data(), obs.size(), start, states);
+
+    return;
   }
+
+  ViterbiDecoder decoder(transition_, sensory_, kTracebackDepth);
+
+  states->clear();
+
+  decoder.Reset(start);
+  decoder.Push(obs.data(), obs.size(), states);
+  decoder.Finish(states);
 }
 
-// Performs Viterbi algorithm
-void EM::PopulateViterbiMatrix(matrix<double> *vit, matrix<int> *back_trace) {
-  for (int x = 1; x < (*vit)[0].size(); ++x) {
-    for (int y = 0; y < vit->size(); ++y) {
-      int index; 
-      double min = numeric_limits<double>::max(); 
-
-      for (int z = 0; z < vit->size(); ++z) {
-        double value = (*vit)[z][x-1] + transition_[y][z];
-     
-        if (value < min) {
-          index = z;
-
-          min = value;
-        }
-      }
-      
-      (*back_trace)[y][x] = index;
+// Adds the moves and observations of states to counts
+void EM::CountStates(const vector<int> &obs, const vector<int> &states, \
+    ExpectedCounts *counts) {
+  for (int x = 1; x < states.size(); ++x) {
+    counts->transition[states[x] * States() + states[x-1]] += 1;
+    counts->sensory[states[x] * Symbols() + obs[x-1]] += 1;
+  }
+}
+
+// Runs work over sequences
+void EM::ForEachSequence(int tasks, \
+    const function<void(int, int)> &work) {
+  atomic<int> next(0);
+  int sequences = observations_.size();
 
-      (*vit)[y][x] = min + ((observations_[0][x-1] == 0) ? sensory_[y][0] : sensory_[y][1]);
+  // Tasks take the next sequence as they finish one, no lock needed
+  Pool()->Run(min(tasks, sequences), [&](int t) {
+    for (int s = next++; s < sequences; s = next++) {
+      work(t, s);
     }
+  });
+}
+
+// Sets threads of training
+void EM::SetTrainThreads(int threads) {
+  train_threads_ = max(threads, 0);
+
+  pool_.reset();
+}
+
+// Returns the pool shared by training and decoding
+ThreadPool *EM::Pool() {
+  if (!pool_) {
+    pool_.reset(new ThreadPool(decode_threads_ >= 0 ? decode_threads_ : \
+        train_threads_));
   }
+
+  return pool_.get();
 }
 
-// Analyzes most likely state sequence and updates transition matrix
-void EM::UpdateTransitionMatrix(matrix<int> states) {
-  int b(0), l(0), m(0); 
-  int b_b(0), b_l(0), b_m(0); 
-  int l_b(0), l_l(0), l_m(0);
-  int m_b(0), m_l(0), m_m(0); 
-  
-  for (int x = 1; x < states[0].size(); ++x) {
-    
-    if (states[0][x-1] == 0 && states[0][x] == 0) {
-     ++b; ++b_b;
-    } else if (states[0][x-1] == 0 && states[0][x] == 1) {
-     ++b; ++b_l;
-    } else if (states[0][x-1] == 0 && states[0][x] == 2) {
-     ++b; ++b_m;
-    } else if (states[0][x-1] == 1 && states[0][x] == 0) {
-     ++l; ++l_b;
-    } else if (states[0][x-1] == 1 && states[0][x] == 1) {
-     ++l; ++l_l;
-    } else if (states[0][x-1] == 1 && states[0][x] == 2) {
-     ++l; ++l_m;
-    } else if (states[0][x-1] == 2 && states[0][x] == 0) {
-     ++m; ++m_b;
-    } else if (states[0][x-1] == 2 && states[0][x] == 1) {
-     ++m; ++m_l;
-    } else if (states[0][x-1] == 2 && states[0][x] == 2) {
-     ++m; ++m_m;
-    } 
-  }
-
-  transition_[0][0] = (double)(b_b + 1)/(double)(b + 3 * 1);
-  transition_[1][0] = (double)(b_l + 1)/(double)(b + 3 * 1);
-  transition_[2][0] = (double)(b_m + 1)/(double)(b + 3 * 1);
-
-  transition_[0][1] = (double)(l_b + 1)/(double)(l + 3 * 1);
-  transition_[1][1] = (double)(l_l + 1)/(double)(l + 3 * 1);
-  transition_[2][1] = (double)(l_m + 1)/(double)(l + 3 * 1);
-
-  transition_[0][2] = (double)(m_b + 1)/(double)(m + 3 * 1);
-  transition_[1][2] = (double)(m_l + 1)/(double)(m + 3 * 1);
-  transition_[2][2] = (double)(m_m + 1)/(double)(m + 3 * 1);
-
-  for (int x = 0; x < 3; ++x) {
-    for (int y = 0; y < 3; ++y) {
-      transition_[x][y] = -log2(transition_[x][y]);
+// Sets threads of parallel decoding
+void EM::SetDecodeThreads(int threads) {
+  decode_threads_ = max(threads, 0);
+
+  pool_.reset();
+}
+
+// Decodes observations in file as they are read
+int EM::DecodeStream(const char *file, int depth) {
+  char c;
+  vector<int> obs, states;
+  ifstream ifs(file);
+  ofstream ofs("output.txt");
+  ViterbiDecoder decoder(transition_, sensory_, \
+      depth > 0 ? depth : kTracebackDepth);
+
+  if (ifs.fail()) {
+    error("Failed to open %s", file);
+
+    return 1;
+  }
+
+  decoder.Reset(vector<double>(States(), -log2((double)1/(double)States())));
+
+  while (ifs.good()) {
+    obs.clear();
+    states.clear();
+
+    while (obs.size() < kStreamBlock && ifs.get(c)) {
+      if (symbol_index_[(unsigned char)c] != -1) {
+        obs.push_back(symbol_index_[(unsigned char)c]);
+      }
+    }
+
+    decoder.Push(obs.data(), obs.size(), &states);
+
+    if (!ifs.good()) {
+      decoder.Finish(&states);
+    }
+
+    for (int i = 0; i < states.size(); ++i) {
+      ofs.put(states_[states[i]]);
     }
   }
+
+  ifs.close();
+  ofs.close();
+
+  return 0;
 }
 
-// Analyzes most likely state sequence and updates sensory matrix
-void EM::UpdateSensoryMatrix(matrix<int> states) {
-  int b(0), l(0), m(0); 
-  int h_b(0), h_l(0), h_m(0); 
-  
-  for (int x = 0; x < observations_[0].size(); ++x) {
-    if (states[0][x+1] == 0) {
-      ++b;
-    } else if (states[0][x+1] == 1) {
-      ++l;
-    } else if (states[0][x+1] == 2) {
-      ++m;
-    } 
-    
-    if (observations_[0][x] == 0 && states[0][x+1] == 0) {
-      ++h_b;
-    } else if (observations_[0][x] == 0 && states[0][x+1] == 1) {
-      ++h_l;
-    } else if (observations_[0][x] == 0 && states[0][x+1] == 2) {
-      ++h_m;
-    } 
+// Updates transition and sensory matrices with expected counts
+void EM::UpdateFromCounts(const ExpectedCounts &counts) {
+  // Expected moves out of each state and observations made in it
+  vector<double> from(States(), 0), seen(States(), 0);
+
+  for (int x = 0; x < States(); ++x) {
+    for (int y = 0; y < States(); ++y) {
+      from[y] += counts.transition[x * States() + y];
+    }
+
+    for (int y = 0; y < Symbols(); ++y) {
+      seen[x] += counts.sensory[x * Symbols() + y];
+    }
   }
-  
-  sensory_[0][0] = (double)(h_b + 1)/(double)(b + 2 * 1);
-  sensory_[1][0] = (double)(h_l + 1)/(double)(l + 2 * 1);
-  sensory_[2][0] = (double)(h_m + 1)/(double)(m + 2 * 1);
 
-  for (int x = 0; x < sensory_.size(); ++x) {
-    sensory_[x][1] = -log2(1-sensory_[x][0]);
-    sensory_[x][0] = -log2(sensory_[x][0]);
+  // Counts are smoothed by adding one to each transition and symbol
+  for (int x = 0; x < States(); ++x) {
+    for (int y = 0; y < States(); ++y) {
+      transition_[x][y] = -log2((counts.transition[x * States() + y] + 1) / \
+          (from[y] + States() * 1));
+    }
+
+    for (int y = 0; y < Symbols(); ++y) {
+      sensory_[x][y] = -log2((counts.sensory[x * Symbols() + y] + 1) / \
+          (seen[x] + Symbols() * 1));
+    }
   }
 }
 
 // Writes most likely state to output file
-void EM::WriteStates(matrix<int> states) {
+void EM::WriteStates(const matrix<int> &states) {
   ofstream ofs("output.txt");
 
-  for (int i = 0; i < states[0].size(); ++i) {
-    ofs.write(kModelStates[states[0][i]], 1); 
+  // Sequences are written a line each
+  for (int s = 0; s < states.size(); ++s) {
+    if (s > 0) {
+      ofs.put('\n');
+    }
+
+    for (int i = 0; i < states[s].size(); ++i) {
+      ofs.put(states_[states[s][i]]); 
+    }
   }
 
   ofs.close();
 }
+
+// Sets alphabet and the index of each of its characters
+void EM::SetAlphabet(const string &names, string *alphabet, int *index) {
+  *alphabet = names;
+
+  for (int c = 0; c < 256; ++c) {
+    index[c] = -1;
+  }
+
+  for (int x = 0; x < names.size(); ++x) {
+    index[(unsigned char)names[x]] = x;
+  }
+}
+
+// Parses alphabet named after key
+bool EM::ParseAlphabet(const string &line, const char *key, string *names) {
+  string token;
+  istringstream iss(line);
+
+  if (!(iss >> token) || token != key) {
+    return false;
+  }
+
+  names->clear();
+
+  while (iss >> token) {
+    *names += token[0];
+  }
+
+  return true;
+}
@@ -35,9 +35,16 @@
 // Error defines
 #define error(M, ...) fprintf(stderr, "%s:%d:" M "\n", __FILE__, __LINE__, ##__VA_ARGS__);
 
+#include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 #include <stdlib.h>
 
+#include "forward_backward.h"
+#include "thread_pool.h"
+
+using std::string;
 using std::vector;
 
 // Helper template for matrix
@@ -55,27 +62,39 @@ using matrix = vector<vector<T> >;
 // 
 // Exmaple usage:
 // EM em;
-// em.ParseObservations("observations.txt");
 // em.ParseTransition("transition.txt");
 // em.ParseSensory("sensory.txt");
+// em.ParseObservations("observations.txt");
 // em.ParseOriginal("original.txt");
 // em.CalculateEM(2);
 //
 // Files observations.txt, transition.txt, sensory.txt and original.txt
-// describe a hidden Markov model. The hidden Markov model process by
-// this class contains 3 states B, L, M and 2 observations H or T. The 
-// class will output the discovered transition and sensory proabilities
-// along with the accuracy.
+// describe a hidden Markov model with N states and M observation
+// symbols. The class will output the discovered transition and sensory
+// proabilities along with the accuracy.
+//
+// Each state and symbol is a single character. The model files may
+// name them on their first line, otherwise the 3 states B, L, M and 2
+// observations H, T are used. Parse the model files first since
+// observations and original states are read in their alphabets.
+//
+// Each line of observations.txt is a separate sequence, and training
+// runs over every sequence without moves from one into the next. A
+// directory of such files may be given instead. original.txt follows
+// the same layout and output.txt gets a line per sequence.
 //
 // observations.txt:
 // HTTHTTTHHHHTTHTTTTT
 // 
-// transition.txt:
+// transition.txt, column y holds the probabilities of moving from y:
+// states: B L M
 // 0.45 0.52 0.25
 // 0.35 0.3 0.13
 // 0.2 0.18 0.62
 //
-// sensory.txt:
+// sensory.txt, a row of M probabilities per state or, with 2 symbols,
+// the probability of the first:
+// symbols: H T
 // 0.5
 // 0.85
 // 0.1
@@ -87,11 +106,12 @@ class EM {
   // Constructor initializes matrices 
   EM();
 
-  // Parses file containing observation data
+  // Parses file or directory containing observation data
   // See class comments for file format
   int ParseObservations(const char *file);
 
-  // Parses file containing transition data
+  // Parses file containing transition data, its row count sets the
+  // number of states
   // See class comments for file format
   int ParseTransition(const char *file);
 
@@ -99,7 +119,7 @@ class EM {
   // See class comments for file format
   int ParseSensory(const char *file); 
 
-  // Parses file containing original data
+  // Parses file or directory containing original data
   // See class comments for file format
   int ParseOriginal(const char *file);
 
@@ -107,42 +127,124 @@ class EM {
   // hidden Markov model
   int CalculateEM(int iterations);
 
+  // Applies Baum-Welch training, EM over the expected counts of
+  // forward-backward passes, printing the log likelihood of each
+  // iteration
+  int CalculateBaumWelch(int iterations);
+
+  // Trains on threads threads from now on, spreading sequences over
+  // them or splitting a single sequence for Baum-Welch, 0 uses every
+  // hardware thread and is the default
+  void SetTrainThreads(int threads);
+
+  // Decodes the most likely states of the observations in file with
+  // the current model, writing them to output.txt as they are decided
+  //
+  // Observations are read in blocks so files of any length decode in
+  // memory bounded by depth, the most observations whose states may be
+  // undecided at once, 0 uses a default depth
+  int DecodeStream(const char *file, int depth);
+
+  // Decodes with the Viterbi algorithm split over chunks of the sequence
+  // on threads threads from now on, 0 uses every hardware thread, the
+  // training pool then has that many threads
+  void SetDecodeThreads(int threads);
+
  private:
   // Helper function to print matrix
   template<typename T> 
   void PrintMatrix(const matrix<T> m);
 
   // Helper function to print state matrix
-  void PrintStateMatrix(const matrix<int> m);
+  void PrintStateMatrix(const matrix<int> &m);
 
   // Helper function to print observation matrix
-  void PrintObservationMatrix(const matrix<int> m);
+  void PrintObservationMatrix(const matrix<int> &m);
 
   // Undoes log base 2 function to matrix values
   void UndoLog2Matrix(matrix<double> *matrix); 
 
   // Calculates accuracy give most likely state sequence
-  double CalculateClassifierAccuracy(const matrix<int> state_seq); 
+  double CalculateClassifierAccuracy(const matrix<int> &state_seq); 
+
+  // Populates most likely state sequence of every observation sequence,
+  // decoding sequences on the training threads at once and adding
+  // their moves and observations to counts unless it is NULL
+  void PopulateLikelyStateSequence(matrix<int> *state_seq,
+                                   ExpectedCounts *counts);
+
+  // Decodes most likely state sequence with a streaming Viterbi decoder,
+  // so no matrix over the whole sequence is kept, or with
+  // ParallelViterbi once decode threads are set
+  void DecodeSequence(const vector<int> &obs, vector<int> *states);
+
+  // Adds the moves and observations of a decoded sequence to counts
+  void CountStates(const vector<int> &obs, const vector<int> &states,
+                   ExpectedCounts *counts);
+
+  // Runs work(task, sequence) for every observation sequence spread
+  // over tasks tasks of the training pool, each task running on one
+  // thread at a time
+  void ForEachSequence(int tasks,
+                       const std::function<void(int, int)> &work);
+
+  // Returns the pool running training and decoding, started on first
+  // use and kept across iterations
+  ThreadPool *Pool();
+
+  // Appends a sequence for each line of file, or of each file in it
+  // when file is a directory, reading characters through index
+  int ParseSequences(const char *file, const int *index,
+                     matrix<int> *sequences);
+
+  // Appends a sequence for each line of file
+  int ReadSequences(const char *file, const int *index,
+                    matrix<int> *sequences);
+
+  // Prints the learned model and writes and scores its most likely
+  // state sequence
+  void ReportModel(const matrix<int> &state_seq);
+
+  // Updates transition and sensory matrices given counts of moves and
+  // observations, expected ones or those of the most likely states
+  void UpdateFromCounts(const ExpectedCounts &counts);
 
-  // Populates most likely state sequence given Viterbi and backtrace matrices
-  void PopulateLikelyStateSequence(const matrix<double> vit, const matrix<int> back_trace, matrix<int> *state_seq);
+  // Writes states to output.txt file
+  void WriteStates(const matrix<int> &states);
 
-  // Populates Viterbi and backtrace matrices
-  void PopulateViterbiMatrix(matrix<double> *vit, matrix<int> *back_trace);
+  // Sets the characters naming states or symbols and the index of each
+  void SetAlphabet(const string &names, string *alphabet, int *index);
 
-  // Updates transition matrix given current states 
-  void UpdateTransitionMatrix(const matrix<int> states);
+  // Returns true when line names an alphabet after key, e.g.
+  // "states: B L M", storing one character per name
+  bool ParseAlphabet(const string &line, const char *key, string *names);
 
-  // Updates sensory matrix given current states and observations
-  void UpdateSensoryMatrix(const matrix<int> states);
+  // Returns the number of hidden states
+  int States() const { return states_.size(); }
 
-  // Writes states to output.txt file
-  void WriteStates(const matrix<int> states);
+  // Returns the number of observation symbols
+  int Symbols() const { return symbols_.size(); }
 
   matrix<int> observations_;
   matrix<double> transition_;
   matrix<double> sensory_;
   matrix<int> original_;
+
+  // Character naming each state and symbol
+  string states_;
+  string symbols_;
+
+  // Index of each character in the alphabets, -1 when not in them
+  int state_index_[256];
+  int symbol_index_[256];
+
+  // Threads decoding the sequence in parallel, -1 decodes it in order
+  int decode_threads_;
+
+  // Threads of the pool when not decoding in parallel, 0 for every
+  // hardware thread
+  int train_threads_;
+  std::unique_ptr<ThreadPool> pool_;
 };
 
 #endif // PROJECT2_EM_H_
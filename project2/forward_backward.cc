@@ -0,0 +1,344 @@
+//The MIT License (MIT)
+//
+//Copyright (c) 2014 Jason Boutte'
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "forward_backward.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include "thread_pool.h"
+
+using namespace std;
+
+// Fewest observations worth a thread of their own
+const long kParallelObservations = 1 << 15;
+
+// Columns are rescaled only once their total drops below this, far from
+// underflow, keeping a division and a log off most steps
+const double kRescale = 1e-100;
+
+// Adds counts of other
+void ExpectedCounts::Add(const ExpectedCounts &other) {
+  for (int x = 0; x < transition.size(); ++x) {
+    transition[x] += other.transition[x];
+  }
+
+  for (int x = 0; x < sensory.size(); ++x) {
+    sensory[x] += other.sensory[x];
+  }
+
+  log_likelihood += other.log_likelihood;
+}
+
+// Constructor
+// Lays out the model contiguously as probabilities
+ForwardBackward::ForwardBackward(const vector<vector<double> > &transition,
+                                 const vector<vector<double> > &sensory,
+                                 ThreadPool *pool)
+  : states_(transition.size()),
+    symbols_(sensory.empty() ? 0 : sensory[0].size()),
+    pool_(pool),
+    transition_(states_ * states_),
+    transposed_(states_ * states_),
+    sensory_(states_ * symbols_) {
+  for (int y = 0; y < states_; ++y) {
+    for (int z = 0; z < states_; ++z) {
+      transition_[y * states_ + z] = pow(2, -transition[y][z]);
+      transposed_[z * states_ + y] = transition_[y * states_ + z];
+    }
+
+    for (int o = 0; o < symbols_; ++o) {
+      sensory_[o * states_ + y] = pow(2, -sensory[y][o]);
+    }
+  }
+}
+
+// Adds expected counts of observations
+void ForwardBackward::Expect(const int *obs, long count,
+                             ExpectedCounts *counts) {
+  switch (states_) {
+    case 2:
+      Run<2>(obs, count, counts);
+      break;
+    case 3:
+      Run<3>(obs, count, counts);
+      break;
+    case 4:
+      Run<4>(obs, count, counts);
+      break;
+    case 8:
+      Run<8>(obs, count, counts);
+      break;
+    default:
+      Run<0>(obs, count, counts);
+      break;
+  }
+}
+
+// Performs forward-backward for N states
+template<int N>
+void ForwardBackward::Run(const int *obs, long count, ExpectedCounts *counts) {
+  int threads = pool_ == NULL ? 1 : \
+      min((long)pool_->Size(), max(count / kParallelObservations, 1L));
+
+  alpha_.resize((count + 1) * states_);
+  scale_.resize(count + 1);
+
+  // One thread sums counts during the backward pass, so beta_ is only
+  // two columns
+  if (threads == 1) {
+    counts->log_likelihood += Forward<N>(obs, count);
+
+    BackwardAccumulate<N>(obs, count, counts);
+
+    return;
+  }
+
+  beta_.resize((count + 1) * states_);
+
+  double log_likelihood(0);
+
+  pool_->Run(2, [&](int task) {
+    if (task == 0) {
+      log_likelihood = Forward<N>(obs, count);
+    } else {
+      Backward<N>(obs, count);
+    }
+  });
+
+  counts->log_likelihood += log_likelihood;
+
+  // Each task sums a chunk of times into counts of its own
+  vector<ExpectedCounts> partial(threads, ExpectedCounts(states_, symbols_));
+
+  pool_->Run(threads, [&](int x) {
+    long begin = 1 + count * x / threads;
+    long end = 1 + count * (x + 1) / threads;
+
+    Accumulate<N>(obs, begin, end, &partial[x]);
+  });
+
+  for (int x = 0; x < threads; ++x) {
+    counts->Add(partial[x]);
+  }
+}
+
+// Performs forward pass for N states
+template<int N>
+double ForwardBackward::Forward(const int *obs, long count) {
+  const int n = N > 0 ? N : states_;
+  const double *trans = &transition_[0];
+  double log_likelihood(0), last(1);
+
+  for (int y = 0; y < n; ++y) {
+    alpha_[y] = 1.0 / n;
+  }
+
+  scale_[0] = 1;
+
+  for (long t = 1; t <= count; ++t) {
+    const double *prev = &alpha_[(t - 1) * n];
+    const double *sens = &sensory_[obs[t - 1] * n];
+    double *cur = &alpha_[t * n];
+    double total(0);
+
+    for (int y = 0; y < n; ++y) {
+      double sum(0);
+
+      for (int z = 0; z < n; ++z) {
+        sum += prev[z] * trans[y * n + z];
+      }
+
+      cur[y] = sum * sens[y];
+      total += cur[y];
+    }
+
+    scale_[t] = 1;
+
+    if (total < kRescale) {
+      double inverse = 1 / total;
+
+      for (int y = 0; y < n; ++y) {
+        cur[y] *= inverse;
+      }
+
+      scale_[t] = total;
+      log_likelihood += log(total);
+      total = 1;
+    }
+
+    last = total;
+  }
+
+  return log_likelihood + log(last);
+}
+
+// Performs backward pass for N states
+template<int N>
+void ForwardBackward::Backward(const int *obs, long count) {
+  const int n = N > 0 ? N : states_;
+  const double *trans = &transposed_[0];
+
+  for (int y = 0; y < n; ++y) {
+    beta_[count * n + y] = 1;
+  }
+
+  // Scaled independently of the forward pass so it can run alongside it
+  for (long t = count; t > 0; --t) {
+    const double *next = &beta_[t * n];
+    const double *sens = &sensory_[obs[t - 1] * n];
+    double *cur = &beta_[(t - 1) * n];
+    double total(0);
+
+    for (int z = 0; z < n; ++z) {
+      double sum(0);
+
+      for (int y = 0; y < n; ++y) {
+        sum += trans[z * n + y] * sens[y] * next[y];
+      }
+
+      cur[z] = sum;
+      total += sum;
+    }
+
+    if (total < kRescale) {
+      double inverse = 1 / total;
+
+      for (int z = 0; z < n; ++z) {
+        cur[z] *= inverse;
+      }
+    }
+  }
+}
+
+// Performs backward pass adding expected counts for N states
+template<int N>
+void ForwardBackward::BackwardAccumulate(const int *obs, long count,
+                                         ExpectedCounts *counts) {
+  const int n = N > 0 ? N : states_;
+  const double *trans = &transition_[0];
+  double *seen = &counts->sensory[0];
+  double local[N > 0 ? N * N : 1] = {};
+  double *moves = N > 0 ? local : &counts->transition[0];
+
+  beta_.assign(2 * n, 1);
+
+  for (long t = count; t > 0; --t) {
+    const double *prev = &alpha_[(t - 1) * n];
+    const double *cur = &alpha_[t * n];
+    const double *sens = &sensory_[obs[t - 1] * n];
+    double *next = &beta_[(t & 1) * n];
+    double *back = &beta_[(~t & 1) * n];
+    int o = obs[t - 1];
+    double total(0), back_total(0);
+
+    for (int y = 0; y < n; ++y) {
+      total += cur[y] * next[y];
+    }
+
+    double inverse = 1 / (total * scale_[t]);
+    double state_inverse = inverse * scale_[t];
+
+    for (int y = 0; y < n; ++y) {
+      seen[y * symbols_ + o] += cur[y] * next[y] * state_inverse;
+    }
+
+    for (int z = 0; z < n; ++z) {
+      back[z] = 0;
+    }
+
+    // Moves from t-1 to t and the backward column of t-1 share the
+    // probability of each move weighted by what follows it
+    for (int y = 0; y < n; ++y) {
+      double weight = sens[y] * next[y];
+
+      for (int z = 0; z < n; ++z) {
+        double move = trans[y * n + z] * weight;
+
+        moves[y * n + z] += prev[z] * move * inverse;
+        back[z] += move;
+      }
+    }
+
+    for (int z = 0; z < n; ++z) {
+      back_total += back[z];
+    }
+
+    if (back_total < kRescale) {
+      for (int z = 0; z < n; ++z) {
+        back[z] /= back_total;
+      }
+    }
+  }
+
+  for (int x = 0; N > 0 && x < n * n; ++x) {
+    counts->transition[x] += local[x];
+  }
+}
+
+// Adds expected counts of times begin to end for N states
+template<int N>
+void ForwardBackward::Accumulate(const int *obs, long begin, long end,
+                                 ExpectedCounts *counts) {
+  const int n = N > 0 ? N : states_;
+  const double *trans = &transition_[0];
+  double *seen = &counts->sensory[0];
+  // Sums moves in a local table when N is fixed, which the compiler
+  // keeps in registers instead of storing every step
+  double local[N > 0 ? N * N : 1] = {};
+  double *moves = N > 0 ? local : &counts->transition[0];
+
+  for (long t = begin; t < end; ++t) {
+    const double *prev = &alpha_[(t - 1) * n];
+    const double *cur = &alpha_[t * n];
+    const double *next = &beta_[t * n];
+    const double *sens = &sensory_[obs[t - 1] * n];
+    int o = obs[t - 1];
+    double total(0);
+
+    for (int y = 0; y < n; ++y) {
+      total += cur[y] * next[y];
+    }
+
+    // Moves from t-1 to t sum to the scale of t times the total
+    double inverse = 1 / (total * scale_[t]);
+    double state_inverse = inverse * scale_[t];
+
+    // Probability of each state at t
+    for (int y = 0; y < n; ++y) {
+      seen[y * symbols_ + o] += cur[y] * next[y] * state_inverse;
+    }
+
+    // Probability of each move from t-1 to t
+    for (int y = 0; y < n; ++y) {
+      double weight = sens[y] * next[y] * inverse;
+
+      for (int z = 0; z < n; ++z) {
+        moves[y * n + z] += prev[z] * trans[y * n + z] * weight;
+      }
+    }
+  }
+
+  for (int x = 0; N > 0 && x < n * n; ++x) {
+    counts->transition[x] += local[x];
+  }
+}
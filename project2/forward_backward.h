@@ -0,0 +1,130 @@
+//The MIT License (MIT)
+//
+//Copyright (c) 2014 Jason Boutte'
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef PROJECT2_FORWARD_BACKWARD_H_
+#define PROJECT2_FORWARD_BACKWARD_H_
+
+#include <vector>
+
+using std::vector;
+
+class ThreadPool;
+
+// Expected transition and emission counts of a hidden Markov model
+struct ExpectedCounts {
+  ExpectedCounts(int states, int symbols)
+    : transition(states * states, 0),
+      sensory(states * symbols, 0),
+      log_likelihood(0) {}
+
+  // Adds counts of other
+  void Add(const ExpectedCounts &other);
+
+  // Expected moves into state y from z at [y * states + z]
+  vector<double> transition;
+
+  // Expected observations of symbol o in state y at [y * symbols + o]
+  vector<double> sensory;
+
+  // Natural log likelihood of the observations counted
+  double log_likelihood;
+};
+
+// Class performs the E-step of Baum-Welch training with scaled forward
+// and backward passes over an observation sequence
+// https://en.wikipedia.org/wiki/Baum%E2%80%93Welch_algorithm
+//
+// The forward and backward passes run at once as two tasks of a thread
+// pool, and the expected counts are then summed over chunks of the
+// sequence, one per pool thread. Without a pool, or with a sequence too
+// short to split,
+// counts are summed during the backward pass instead. Each pass
+// rescales a column whenever its total gets small so long sequences do
+// not underflow.
+//
+// Example usage:
+// ForwardBackward fb(transition, sensory, &pool);
+// ExpectedCounts counts(states, symbols);
+// fb.Expect(obs, count, &counts);
+//
+// Costs are -log2 probabilities as in ViterbiDecoder. As in the Viterbi
+// training the sequence starts in a uniformly chosen state before the
+// first observation.
+class ForwardBackward {
+ public:
+  // Constructor converts the model to probabilities, passes run on
+  // pool unless it is NULL
+  ForwardBackward(const vector<vector<double> > &transition,
+                  const vector<vector<double> > &sensory, ThreadPool *pool);
+
+  // Adds the expected counts of count observations to counts
+  void Expect(const int *obs, long count, ExpectedCounts *counts);
+
+ private:
+  // Passes with the number of states N fixed at compile time so loops
+  // over states unroll, N of 0 handles any number
+  template<int N>
+  void Run(const int *obs, long count, ExpectedCounts *counts);
+
+  // Fills alpha_ and scale_, returning the log likelihood
+  template<int N>
+  double Forward(const int *obs, long count);
+
+  // Fills beta_
+  template<int N>
+  void Backward(const int *obs, long count);
+
+  // Performs the backward pass adding expected counts as it goes
+  template<int N>
+  void BackwardAccumulate(const int *obs, long count,
+                          ExpectedCounts *counts);
+
+  // Adds the expected counts of times begin to end
+  template<int N>
+  void Accumulate(const int *obs, long begin, long end,
+                  ExpectedCounts *counts);
+
+  int states_;
+  int symbols_;
+
+  // Pool running the passes and chunks, NULL runs them on the caller
+  ThreadPool *pool_;
+
+  // Probability of moving into state y from z at [y * states_ + z] and
+  // the transpose
+  vector<double> transition_;
+  vector<double> transposed_;
+
+  // Probability of observing symbol o in state y at [o * states_ + y]
+  vector<double> sensory_;
+
+  // Scaled forward and backward probabilities, a row of states_ per time,
+  // beta_ keeps only two rows when counts are summed during its pass
+  vector<double> alpha_;
+  vector<double> beta_;
+
+  // Factor the forward column of each time was divided by, 1 when it
+  // was not rescaled
+  vector<double> scale_;
+};
+
+#endif // PROJECT2_FORWARD_BACKWARD_H_
@@ -2,16 +2,12 @@
 
 #include "em.h"
 
+#include <string.h>
+
 
 int main(int argc, char **argv) {
   EM em;
 
-  if (em.ParseObservations(argv[1])) {
-    error("Failed to parse observations");
-
-    exit(1);
-  }
-
   if (em.ParseTransition(argv[2])) {
     error("Failed to parse transition");
 
@@ -24,12 +20,57 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  // Decodes observations with the given model without loading them,
+  // e.g. em observations.txt transition.txt sensory.txt --stream 4096
+  if (argc > 4 && strcmp(argv[4], "--stream") == 0) {
+    if (em.DecodeStream(argv[1], argc > 5 ? atoi(argv[5]) : 0)) {
+      error("Failed to decode stream");
+
+      exit(1);
+    }
+
+    return 0;
+  }
+
+  if (em.ParseObservations(argv[1])) {
+    error("Failed to parse observations");
+
+    exit(1);
+  }
+
   if (em.ParseOriginal(argv[4])) {
     error("Failed to parse original");
 
     exit(1);
   }
 
+  // Decodes chunks of the sequence on threads at once when asked, e.g.
+  // em observations.txt transition.txt sensory.txt original.txt 8 --parallel 4
+  if (argc > 6 && strcmp(argv[6], "--parallel") == 0) {
+    em.SetDecodeThreads(argc > 7 ? atoi(argv[7]) : 0);
+  }
+
+  // Trains on the given number of threads instead of every hardware
+  // thread, e.g.
+  // em observations/ transition.txt sensory.txt original/ 8 --threads 4
+  if (argc > 6 && strcmp(argv[6], "--threads") == 0) {
+    em.SetTrainThreads(argc > 7 ? atoi(argv[7]) : 0);
+  }
+
+  // Trains with Baum-Welch instead of the Viterbi path when asked, e.g.
+  // em observations.txt transition.txt sensory.txt original.txt 8 --baum-welch 4
+  if (argc > 6 && strcmp(argv[6], "--baum-welch") == 0) {
+    em.SetTrainThreads(argc > 7 ? atoi(argv[7]) : 0);
+
+    if (em.CalculateBaumWelch(atoi(argv[5]))) {
+      error("Failed to calculate baum-welch");
+
+      exit(1);
+    }
+
+    return 0;
+  }
+
   if (em.CalculateEM(atoi(argv[5]))) {
     error("Failed to calculate em");
 
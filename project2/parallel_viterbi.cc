@@ -0,0 +1,216 @@
+//The MIT License (MIT)
+//
+//Copyright (c) 2014 Jason Boutte'
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "parallel_viterbi.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "thread_pool.h"
+#include "viterbi_decoder.h"
+
+using namespace std;
+
+// Fewest observations worth a chunk of their own
+const long kMinChunk = 1 << 12;
+
+// Path costs are rebased once the least one exceeds this, as in
+// ViterbiDecoder
+const double kRebaseCost = 1 << 20;
+
+// Observations whose states may be undecided at once in a chunk
+const int kChunkDepth = 1 << 16;
+
+// Constructor
+// Lays out the model contiguously
+ParallelViterbi::ParallelViterbi(const vector<vector<double> > &transition,
+                                 const vector<vector<double> > &sensory,
+                                 ThreadPool *pool)
+  : model_transition_(transition),
+    model_sensory_(sensory),
+    states_(transition.size()),
+    pool_(pool),
+    transition_(states_ * states_),
+    sensory_(sensory.empty() ? 0 : sensory[0].size() * states_) {
+  for (int y = 0; y < states_; ++y) {
+    for (int z = 0; z < states_; ++z) {
+      transition_[y * states_ + z] = transition[y][z];
+    }
+
+    for (int o = 0; o < sensory[y].size(); ++o) {
+      sensory_[o * states_ + y] = sensory[y][o];
+    }
+  }
+}
+
+// Decodes observations over chunks
+void ParallelViterbi::Decode(const int *obs, long count,
+                             const vector<double> &start,
+                             vector<int> *states) {
+  const int n = states_;
+  int chunks = min((long)pool_->Size(), max(count / kMinChunk, 1L));
+  vector<long> bounds(chunks + 1);
+  vector<vector<double> > transfer(chunks);
+  vector<vector<int> > decoded(chunks);
+
+  for (int k = 0; k <= chunks; ++k) {
+    bounds[k] = count * k / chunks;
+  }
+
+  // Finds the transfer matrix of every chunk at once
+  pool_->Run(chunks, [&](int k) {
+    const int *begin = obs + bounds[k];
+    long length = bounds[k + 1] - bounds[k];
+
+    switch (n) {
+      case 2:
+        Transfer<2>(begin, length, &transfer[k]);
+        break;
+      case 3:
+        Transfer<3>(begin, length, &transfer[k]);
+        break;
+      case 4:
+        Transfer<4>(begin, length, &transfer[k]);
+        break;
+      case 8:
+        Transfer<8>(begin, length, &transfer[k]);
+        break;
+      default:
+        Transfer<0>(begin, length, &transfer[k]);
+        break;
+    }
+  });
+
+  // Combines the matrices in order giving the cost of each state at
+  // each boundary, there are only as many as threads so this is cheap
+  vector<vector<double> > boundary(chunks + 1, start);
+
+  for (int k = 0; k < chunks; ++k) {
+    for (int y = 0; y < n; ++y) {
+      double min = numeric_limits<double>::max();
+
+      for (int z = 0; z < n; ++z) {
+        min = std::min(min, boundary[k][z] + transfer[k][y * n + z]);
+      }
+
+      boundary[k + 1][y] = min;
+    }
+  }
+
+  // Walks back from the best final state to the best state at each
+  // boundary, ties going to the lower state as in ViterbiDecoder
+  vector<int> through(chunks + 1);
+
+  through[chunks] = min_element(boundary[chunks].begin(), \
+      boundary[chunks].end()) - boundary[chunks].begin();
+
+  for (int k = chunks - 1; k >= 0; --k) {
+    double min = numeric_limits<double>::max();
+
+    through[k] = 0;
+
+    for (int z = 0; z < n; ++z) {
+      double value = boundary[k][z] + transfer[k][through[k + 1] * n + z];
+
+      if (value < min) {
+        through[k] = z;
+
+        min = value;
+      }
+    }
+  }
+
+  // Decodes every chunk between its boundary states at once
+  pool_->Run(chunks, [&](int k) {
+    ViterbiDecoder decoder(model_transition_, model_sensory_, kChunkDepth);
+    vector<double> from(n, numeric_limits<double>::infinity());
+
+    from[through[k]] = 0;
+
+    decoder.Reset(from);
+    decoder.Push(obs + bounds[k], bounds[k + 1] - bounds[k], &decoded[k]);
+    decoder.Finish(through[k + 1], &decoded[k]);
+  });
+
+  states->clear();
+
+  // Each chunk repeats the boundary state the previous one ended in
+  for (int k = 0; k < chunks; ++k) {
+    states->insert(states->end(), decoded[k].begin() + (k > 0 ? 1 : 0), \
+        decoded[k].end());
+  }
+}
+
+// Finds transfer matrix for N states
+template<int N>
+void ParallelViterbi::Transfer(const int *obs, long count,
+                               vector<double> *transfer) {
+  const int n = N > 0 ? N : states_;
+  const double *trans = &transition_[0];
+  // Path costs of each state for a start in z at [z * n + y], less the
+  // offset of z taken out when rebasing
+  vector<double> cost(n * n, numeric_limits<double>::infinity());
+  vector<double> next(n * n), offset(n, 0);
+
+  for (int z = 0; z < n; ++z) {
+    cost[z * n + z] = 0;
+  }
+
+  for (long t = 0; t < count; ++t) {
+    const double *sens = &sensory_[obs[t] * n];
+
+    for (int z = 0; z < n; ++z) {
+      const double *from = &cost[z * n];
+      double *to = &next[z * n];
+      double least = numeric_limits<double>::max();
+
+      for (int y = 0; y < n; ++y) {
+        double min = numeric_limits<double>::max();
+
+        for (int w = 0; w < n; ++w) {
+          min = std::min(min, from[w] + trans[y * n + w]);
+        }
+
+        to[y] = min + sens[y];
+        least = std::min(least, to[y]);
+      }
+
+      if (least > kRebaseCost) {
+        for (int y = 0; y < n; ++y) {
+          to[y] -= least;
+        }
+
+        offset[z] += least;
+      }
+    }
+
+    cost.swap(next);
+  }
+
+  transfer->resize(n * n);
+
+  for (int y = 0; y < n; ++y) {
+    for (int z = 0; z < n; ++z) {
+      (*transfer)[y * n + z] = cost[z * n + y] + offset[z];
+    }
+  }
+}
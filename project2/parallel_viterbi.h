@@ -0,0 +1,88 @@
+//The MIT License (MIT)
+//
+//Copyright (c) 2014 Jason Boutte'
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef PROJECT2_PARALLEL_VITERBI_H_
+#define PROJECT2_PARALLEL_VITERBI_H_
+
+#include <vector>
+
+using std::vector;
+
+class ThreadPool;
+
+// Class decodes the most likely state sequence of one long observation
+// sequence with the Viterbi algorithm split over chunks run by a thread
+// pool
+//
+// Each task first finds its chunk's transfer matrix, the least cost
+// of crossing the chunk from every state to every state. Combining the
+// matrices in order with the start costs gives the path cost of every
+// state at each chunk boundary, and walking them back from the best
+// final state gives the state the best path passes through at each
+// boundary. Each task then decodes its chunk between those states.
+//
+// Example usage:
+// ParallelViterbi viterbi(transition, sensory, &pool);
+// viterbi.Decode(obs, count, start, &states);
+//
+// Costs are -log2 probabilities as in ViterbiDecoder. Every chunk does
+// the work of one Viterbi pass per state to find its transfer matrix,
+// so this pays off for small state counts with cores to spare.
+class ParallelViterbi {
+ public:
+  // Constructor copies the model, chunks run on pool with one chunk per
+  // pool thread
+  ParallelViterbi(const vector<vector<double> > &transition,
+                  const vector<vector<double> > &sensory, ThreadPool *pool);
+
+  // Decodes count observations given the cost of each initial state,
+  // replacing states with the count+1 states of the best path
+  void Decode(const int *obs, long count, const vector<double> &start,
+              vector<int> *states);
+
+ private:
+  // Finds the transfer matrix of observations with the number of
+  // states N fixed at compile time so loops over states unroll, N of 0
+  // handles any number
+  //
+  // transfer[y * states + z] is the least cost of moving from z before
+  // the first observation to y after the last
+  template<int N>
+  void Transfer(const int *obs, long count, vector<double> *transfer);
+
+  // Model as given, for the decoders of each chunk
+  vector<vector<double> > model_transition_;
+  vector<vector<double> > model_sensory_;
+
+  int states_;
+
+  // Pool running the chunks
+  ThreadPool *pool_;
+
+  // Transition costs into each state, adjacent as the recurrence reads
+  vector<double> transition_;
+
+  // Observation costs of each state, adjacent per symbol
+  vector<double> sensory_;
+};
+
+#endif // PROJECT2_PARALLEL_VITERBI_H_
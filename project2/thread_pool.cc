@@ -0,0 +1,134 @@
+//The MIT License (MIT)
+//
+//Copyright (c) 2014 Jason Boutte'
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "thread_pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// Constructor
+ThreadPool::ThreadPool(int threads)
+  : call_(NULL),
+    fn_(NULL),
+    tasks_(0),
+    next_(0),
+    active_(0),
+    batch_(0),
+    stop_(false) {
+  if (threads <= 0) {
+    threads = max((int)thread::hardware_concurrency(), 1);
+  }
+
+  for (int x = 1; x < threads; ++x) {
+    workers_.push_back(thread(&ThreadPool::Work, this));
+  }
+}
+
+// Destructor
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(mutex_);
+
+    stop_ = true;
+  }
+
+  wake_.notify_all();
+
+  for (int x = 0; x < workers_.size(); ++x) {
+    workers_[x].join();
+  }
+}
+
+// Runs a batch of tasks
+void ThreadPool::RunTasks(int tasks, void (*call)(const void *, int),
+                          const void *fn) {
+  // A single task is not worth waking the workers for
+  if (tasks <= 1 || workers_.empty()) {
+    for (int x = 0; x < tasks; ++x) {
+      call(fn, x);
+    }
+
+    return;
+  }
+
+  {
+    lock_guard<mutex> lock(mutex_);
+
+    call_ = call;
+    fn_ = fn;
+    tasks_ = tasks;
+    next_ = 0;
+    active_ = workers_.size();
+    ++batch_;
+  }
+
+  wake_.notify_all();
+
+  Drain();
+
+  // Waits for the workers so fn stays valid while they use it
+  unique_lock<mutex> lock(mutex_);
+
+  done_.wait(lock, [this] { return active_ == 0; });
+
+  call_ = NULL;
+  fn_ = NULL;
+}
+
+// Runs batches until stopped
+void ThreadPool::Work() {
+  unsigned batch(0);
+
+  while (true) {
+    {
+      unique_lock<mutex> lock(mutex_);
+
+      wake_.wait(lock, [&] { return stop_ || batch_ != batch; });
+
+      if (stop_) {
+        return;
+      }
+
+      batch = batch_;
+    }
+
+    Drain();
+
+    {
+      lock_guard<mutex> lock(mutex_);
+
+      if (--active_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+}
+
+// Runs tasks of the current batch
+void ThreadPool::Drain() {
+  int task;
+
+  while ((task = next_++) < tasks_) {
+    call_(fn_, task);
+  }
+}
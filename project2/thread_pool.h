@@ -0,0 +1,102 @@
+//The MIT License (MIT)
+//
+//Copyright (c) 2014 Jason Boutte'
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef PROJECT2_THREAD_POOL_H_
+#define PROJECT2_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+// Class keeps worker threads alive between batches of indexed tasks so
+// training iterations do not start threads of their own
+//
+// Example usage:
+// ThreadPool pool(4);
+// pool.Run(tasks, [&](int task) { ... });
+//
+// Tasks are handed out as workers become free, so results wanted in a
+// fixed order should be stored by task and combined afterwards.
+class ThreadPool {
+ public:
+  // Constructor starts threads-1 workers, the caller of Run is the last
+  // one, threads of 0 uses every hardware thread
+  explicit ThreadPool(int threads);
+
+  // Destructor stops and joins the workers
+  ~ThreadPool();
+
+  // Returns the number of threads including the caller
+  int Size() const { return workers_.size() + 1; }
+
+  // Calls fn(task) for every task in [0, tasks) returning once all of
+  // them have completed, through a function pointer so no std::function
+  // is allocated per batch
+  template<typename F>
+  void Run(int tasks, const F &fn) {
+    RunTasks(tasks, &CallTask<F>, &fn);
+  }
+
+ private:
+  // Calls task of the callable of type F at fn
+  template<typename F>
+  static void CallTask(const void *fn, int task) {
+    (*static_cast<const F *>(fn))(task);
+  }
+
+  // Runs call(fn, task) for every task as Run describes
+  void RunTasks(int tasks, void (*call)(const void *, int), const void *fn);
+
+  // Waits for batches running their tasks
+  void Work();
+
+  // Runs tasks of the current batch until none remain
+  void Drain();
+
+  vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+
+  // Callable of the current batch with the function calling it, the
+  // count of tasks and the next task
+  void (*call_)(const void *, int);
+  const void *fn_;
+  int tasks_;
+  std::atomic<int> next_;
+
+  // Workers still running the current batch
+  int active_;
+
+  // Incremented for every batch so workers wake once per batch
+  unsigned batch_;
+  bool stop_;
+
+  ThreadPool(const ThreadPool &);
+  ThreadPool &operator=(const ThreadPool &);
+};
+
+#endif // PROJECT2_THREAD_POOL_H_
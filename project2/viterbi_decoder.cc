@@ -0,0 +1,225 @@
+//The MIT License (MIT)
+//
+//Copyright (c) 2014 Jason Boutte'
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "viterbi_decoder.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+// Observations between checks for converged survivor paths
+const int kConvergeInterval = 32;
+
+// Path costs are rebased once the least one exceeds this, late enough
+// that ordinary sequences are never rebased and costs keep full precision
+const double kRebaseCost = 1 << 20;
+
+// Constructor
+// Lays out the model contiguously
+ViterbiDecoder::ViterbiDecoder(const vector<vector<double> > &transition,
+                               const vector<vector<double> > &sensory,
+                               int depth)
+  : states_(transition.size()),
+    depth_(max(depth, 1)),
+    transition_(states_ * states_),
+    sensory_(sensory.empty() ? 0 : sensory[0].size() * states_),
+    cost_(states_),
+    next_(states_),
+    back_((size_t)depth_ * states_),
+    path_(depth_ + 1),
+    seen_(states_, -1),
+    time_(0),
+    decided_(0) {
+  for (int y = 0; y < states_; ++y) {
+    for (int z = 0; z < states_; ++z) {
+      transition_[y * states_ + z] = transition[y][z];
+    }
+
+    for (int o = 0; o < sensory[y].size(); ++o) {
+      sensory_[o * states_ + y] = sensory[y][o];
+    }
+  }
+}
+
+// Starts a new sequence
+void ViterbiDecoder::Reset(const vector<double> &start) {
+  cost_ = start;
+  time_ = 0;
+  decided_ = 0;
+}
+
+// Advances over observations
+void ViterbiDecoder::Push(const int *obs, int count, vector<int> *states) {
+  switch (states_) {
+    case 2:
+      Advance<2>(obs, count, states);
+      break;
+    case 3:
+      Advance<3>(obs, count, states);
+      break;
+    case 4:
+      Advance<4>(obs, count, states);
+      break;
+    case 8:
+      Advance<8>(obs, count, states);
+      break;
+    default:
+      Advance<0>(obs, count, states);
+      break;
+  }
+}
+
+// Performs Viterbi algorithm for N states
+template<int N>
+void ViterbiDecoder::Advance(const int *obs, int count, vector<int> *states) {
+  const int n = N > 0 ? N : states_;
+  const double *trans = &transition_[0];
+
+  for (int i = 0; i < count; ++i) {
+    int *back = Column(time_ + 1);
+    const double *sens = &sensory_[obs[i] * n];
+    double least = numeric_limits<double>::max();
+
+    for (int y = 0; y < n; ++y) {
+      int index(0);
+      double min = numeric_limits<double>::max();
+
+      for (int z = 0; z < n; ++z) {
+        double value = cost_[z] + trans[y * n + z];
+
+        if (value < min) {
+          index = z;
+
+          min = value;
+        }
+      }
+
+      back[y] = index;
+
+      next_[y] = min + sens[y];
+      least = std::min(least, next_[y]);
+    }
+
+    cost_.swap(next_);
+    ++time_;
+
+    if (least > kRebaseCost) {
+      for (int y = 0; y < n; ++y) {
+        cost_[y] -= least;
+      }
+    }
+
+    if (time_ - decided_ == depth_) {
+      Decide(states);
+    } else if ((time_ - decided_) % kConvergeInterval == 0) {
+      Converge(states);
+    }
+  }
+}
+
+// Appends the states still undecided
+void ViterbiDecoder::Finish(vector<int> *states) {
+  Finish(Best(), states);
+}
+
+// Appends the states still undecided ending in state
+void ViterbiDecoder::Finish(int state, vector<int> *states) {
+  Trace(time_, state);
+  Emit(time_ - decided_ + 1, states);
+}
+
+// Emits the states every survivor path agrees on
+void ViterbiDecoder::Converge(vector<int> *states) {
+  live_.resize(states_);
+
+  for (int y = 0; y < states_; ++y) {
+    live_[y] = y;
+  }
+
+  // Follows the survivors of every state back until they merge
+  for (long t = time_; t > decided_; --t) {
+    const int *back = Column(t);
+    int live(0);
+
+    for (int x = 0; x < live_.size(); ++x) {
+      int prev = back[live_[x]];
+
+      if (seen_[prev] != t) {
+        seen_[prev] = t;
+        live_[live++] = prev;
+      }
+    }
+
+    live_.resize(live);
+
+    if (live == 1) {
+      Trace(t - 1, live_[0]);
+      Emit(t - decided_, states);
+
+      break;
+    }
+  }
+
+  // Marks are times of the window, so they are cleared for the next one
+  fill(seen_.begin(), seen_.end(), -1);
+}
+
+// Emits the oldest half of the window
+void ViterbiDecoder::Decide(vector<int> *states) {
+  Trace(time_, Best());
+  Emit(max(depth_ / 2, 1), states);
+}
+
+// Traces back from state at time t
+void ViterbiDecoder::Trace(long t, int state) {
+  path_[t - decided_] = state;
+
+  for (long x = t; x > decided_; --x) {
+    state = Column(x)[state];
+
+    path_[x - 1 - decided_] = state;
+  }
+}
+
+// Appends traced states
+void ViterbiDecoder::Emit(long count, vector<int> *states) {
+  states->insert(states->end(), path_.begin(), path_.begin() + count);
+
+  decided_ += count;
+}
+
+// Returns the state of least cost
+int ViterbiDecoder::Best() const {
+  int index(0);
+  double min = numeric_limits<double>::max();
+
+  for (int y = 0; y < states_; ++y) {
+    if (cost_[y] < min) {
+      index = y;
+
+      min = cost_[y];
+    }
+  }
+
+  return index;
+}
@@ -0,0 +1,118 @@
+//The MIT License (MIT)
+//
+//Copyright (c) 2014 Jason Boutte'
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef PROJECT2_VITERBI_DECODER_H_
+#define PROJECT2_VITERBI_DECODER_H_
+
+#include <vector>
+
+using std::vector;
+
+// Class decodes the most likely state sequence of an observation stream
+// with the Viterbi algorithm while keeping only a rolling window of
+// back pointers, so memory does not grow with the length of the stream
+//
+// States are emitted as soon as every survivor path agrees on them. If
+// the window fills first, the oldest half is decided by the path ending
+// in the currently most likely state.
+//
+// Example usage:
+// ViterbiDecoder decoder(transition, sensory, 4096);
+// decoder.Reset(start);
+// decoder.Push(obs, count, &states);
+// decoder.Finish(&states);
+//
+// Costs are -log2 probabilities, transition[y][z] is the cost of moving
+// from z to y and sensory[y][o] the cost of observing o in y. The
+// decoded sequence starts with the state before the first observation.
+class ViterbiDecoder {
+ public:
+  // Constructor copies the model, depth is the most observations whose
+  // states may be undecided at once
+  ViterbiDecoder(const vector<vector<double> > &transition,
+                 const vector<vector<double> > &sensory, int depth);
+
+  // Starts a new sequence with the cost of each initial state
+  void Reset(const vector<double> &start);
+
+  // Advances over count observations appending decided states
+  void Push(const int *obs, int count, vector<int> *states);
+
+  // Appends the states still undecided at the end of the sequence
+  void Finish(vector<int> *states);
+
+  // Appends the states still undecided on the path ending in state
+  void Finish(int state, vector<int> *states);
+
+ private:
+  // Advances over observations with the number of states N fixed at
+  // compile time so loops over states unroll, N of 0 handles any number
+  template<int N>
+  void Advance(const int *obs, int count, vector<int> *states);
+
+  // Emits the states every survivor path agrees on
+  void Converge(vector<int> *states);
+
+  // Emits the oldest half of the window following the best path
+  void Decide(vector<int> *states);
+
+  // Fills path_ with states from decided_ to t given the state at t
+  void Trace(long t, int state);
+
+  // Appends the first count states of path_ and drops their columns
+  void Emit(long count, vector<int> *states);
+
+  // Returns the back pointers to time t-1 of the states at time t
+  int *Column(long t) { return &back_[(t % depth_) * states_]; }
+
+  // Returns the state of least cost
+  int Best() const;
+
+  int states_;
+  int depth_;
+
+  // Transition costs into each state, adjacent as the recurrence reads
+  vector<double> transition_;
+
+  // Observation costs of each state, adjacent per symbol
+  vector<double> sensory_;
+
+  // Path costs of each state at the newest time and the next one
+  vector<double> cost_;
+  vector<double> next_;
+
+  // Ring of depth_ columns of back pointers
+  vector<int> back_;
+
+  // States traced back from a time and states still on a survivor path
+  vector<int> path_;
+  vector<int> live_;
+
+  // Newest time each state was reached while following survivors
+  vector<long> seen_;
+
+  // Newest time with a column and the first time not yet emitted
+  long time_;
+  long decided_;
+};
+
+#endif // PROJECT2_VITERBI_DECODER_H_